@@ -0,0 +1,16 @@
+#pragma once
+
+#include "game_shared.h"
+
+namespace game {
+
+// On-device micro-benchmarks, run from the current camera pose. Each returns
+// a JSON object for /api/bench.
+String benchProjectionJson();
+// Per-frame world draw time of both render engines over eight headings.
+String benchEngineJson();
+// Painter face fill: two GFX fillTriangle calls against rasterFillQuad, on
+// the face lists recorded at eight headings.
+String benchQuadFillJson();
+
+}  // namespace game
@@ -8,8 +8,11 @@
 #include <WebServer.h>
 #include <WiFi.h>
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 namespace game {
 
@@ -29,6 +32,18 @@ inline constexpr int kTftBlk = 9;
 inline constexpr int kBtnLeft = 39;   // BTN39
 inline constexpr int kBtnRight = 40;  // BTN40
 
+enum RasterMode : uint8_t {
+  RASTER_PAINTER = 0,  // Back-to-front over a cleared canvas.
+  RASTER_SPANS = 1,    // Front-to-back, each pixel written once via coverage spans.
+  RASTER_ZBUFFER = 2,  // Unsorted faces with a 16-bit per-pixel 1/z test.
+  RASTER_TILED = 3,    // Painter order, binned into 32x32 tiles drawn in a scratch buffer.
+};
+
+enum RenderEngine : uint8_t {
+  ENGINE_POLYGON = 0,  // Projected face quads (buildVisibleFaces + kRasterMode).
+  ENGINE_RAYCAST = 1,  // One DDA ray per screen column, pitch applied as a shear.
+};
+
 inline constexpr int kScreenW = 160;
 inline constexpr int kScreenH = 128;
 inline constexpr float kFocal = 90.0f;
@@ -43,12 +58,67 @@ inline constexpr float kPlayerHeight = 1.82f;
 inline constexpr float kPlayerRadius = 0.27f;
 inline constexpr float kMaxPitch = 1.52f;
 inline constexpr float kRenderRadius = 9.0f;
+// Let the render governor trim the radius (and the face cap with it) down
+// to kRenderRadiusMin while frames run over kTargetFrameUs.
+inline constexpr bool kAdaptiveRadius = true;
+inline constexpr float kRenderRadiusMin = 5.0f;
+// Columns beyond this distance are drawn from the heightmap as surface
+// impostors; set it to kRenderRadius or more to disable the far tier.
+inline constexpr float kLodRadius = 6.0f;
 inline constexpr bool kDrawEdges = false;
+inline constexpr bool kGreedyMeshing = true;
+// Emit unit voxel faces far-to-near by walking the window towards the
+// camera cell on each axis, so the near tier needs no depth sort. Merged
+// quads have no such order, so this bypasses kGreedyMeshing.
+inline constexpr bool kOctantOrder = false;
+inline constexpr bool kHorizonCulling = true;
+// RASTER_TILED bounds overdraw to a scratch tile but has not been timed on
+// the device yet; compare raster_us in the [stat] line before switching.
+inline constexpr RasterMode kRasterMode = RASTER_PAINTER;
+// Painter mode fills each face with one edge walk and paired-pixel row
+// stores instead of two GFX fillTriangle calls (/api/bench?what=quad).
+inline constexpr bool kNativeQuadFill = true;
+// Compare the two with /api/bench?what=engine.
+inline constexpr RenderEngine kRenderEngine = ENGINE_POLYGON;
+// Q16.16 integer transform instead of float; compare with /api/bench?what=proj.
+inline constexpr bool kFixedPointProjection = false;
+// Only push 16x16 tiles that changed since the previous frame. Off until
+// present_us / present_bytes in the [stat] line are measured both ways.
+inline constexpr bool kDirtyTilePresent = false;
+// Send frame N from a task on the other core while frame N+1 is rendered.
+// Off until present_wait_us shows the overlap paying off on the device.
+inline constexpr bool kAsyncPresent = false;
+inline constexpr int kPresentCore = 0;
+// RASTER_TILED: a helper task on the other core draws tile rows alongside
+// the render loop; both claim rows from a shared counter. The helper shares
+// core 0 with WiFi, present and the MC task, so it runs above the latter two
+// (the render loop waits on it every frame). Off until raster_us in the
+// [stat] line shows it paying off on the device.
+inline constexpr bool kParallelRaster = false;
+inline constexpr int kRasterHelperCore = 0;
+inline constexpr int kRasterHelperPriority = 3;
+// Under load, draw the world at 3/4 or 1/2 resolution and scale it up;
+// the HUD stays native. Used once the radius is already at its minimum.
+inline constexpr bool kDynamicResolution = true;
+// Render-time budget the governor steers to, measured without present.
+inline constexpr unsigned long kTargetFrameUs = 50000;
+// View scale levels, in quarters of the native size.
+inline constexpr uint8_t kViewScaleMin = 2;
+inline constexpr uint8_t kViewScaleFull = 4;
+// Skip the world render and the panel push while nothing on screen would
+// change, sleeping kIdleSleepMs per skipped frame instead.
+inline constexpr bool kIdleFrameSkip = true;
+inline constexpr unsigned long kIdleSleepMs = 4;
 
 inline constexpr int kWorldW = 16;
 inline constexpr int kWorldD = 16;
 inline constexpr int kWorldHMax = 14;
 inline constexpr int kMaxFaces = 2600;
+// Lowest face budget /api/face_budget accepts.
+inline constexpr int kFaceBudgetMin = 200;
+inline constexpr int kDepthSortBits = 12;
+// Face depths beyond this (camera-space z) share the farthest sort bucket.
+inline constexpr float kDepthSortMax = kRenderRadius + kWorldHMax;
 inline constexpr int kInvSlots = 5;
 inline constexpr int kInvStackMax = 99;
 inline constexpr uint8_t kInvStartBlocks = 48;
@@ -60,10 +130,100 @@ inline constexpr unsigned long kControlTimeoutMs = 2200;
 inline constexpr unsigned long kPlaceCooldownMs = 120;
 inline constexpr unsigned long kMcReconnectMs = 5000;
 inline constexpr unsigned long kMcMovePacketMs = 200;
+// Run the socket / protocol side of the MC client in its own task so that
+// blocking sends and chunk decoding never stall a rendered frame. Off until
+// the split has been exercised on the device.
+inline constexpr bool kMcClientTask = false;
+inline constexpr int kMcClientCore = 0;
 inline constexpr uint16_t kMcDefaultPort = 25565;
 inline constexpr char kMcDefaultHost[] = "192.168.3.144";
 inline constexpr char kMcDefaultPlayer[] = "esp32player";
 
+// Render into an 8-bit palette-indexed framebuffer (20 KB instead of 40 KB
+// at 160x128). Indices are expanded to RGB565 one line at a time by the
+// present path, so the panel still receives 16-bit pixels. Off until it is
+// measured on the device; colours past 256 share their nearest entry.
+inline constexpr bool kIndexedFramebuffer = false;
+
+// One framebuffer pixel: a palette index, or RGB565 when not indexed.
+using Pixel = std::conditional<kIndexedFramebuffer, uint8_t, uint16_t>::type;
+
+// RGB565 colour of each palette index handed out so far.
+extern uint16_t s_palette[256];
+
+// Transparent fill of the off-screen HUD strips. Its palette index is
+// reserved up front and never handed to another colour.
+inline constexpr uint16_t kHudKey = 0x0821;
+
+// Palette index for an RGB565 colour, allocated on first use. The scene uses a
+// few dozen colours; once all 256 entries are taken, new colours share the
+// nearest existing entry other than kHudKey's.
+uint8_t paletteIndex(uint16_t rgb);
+
+inline Pixel toPixel(uint16_t rgb) {
+  if constexpr (kIndexedFramebuffer) {
+    return paletteIndex(rgb);
+  } else {
+    return static_cast<Pixel>(rgb);
+  }
+}
+
+inline uint16_t pixelRgb(Pixel px) {
+  if constexpr (kIndexedFramebuffer) {
+    return s_palette[px];
+  } else {
+    return static_cast<uint16_t>(px);
+  }
+}
+
+// Fills [x0, x1) with 32-bit stores between the unaligned ends. Rows start
+// 4-byte aligned, so only the first and last partial words take narrow stores.
+inline void fillRow(Pixel *row, int x0, int x1, Pixel color) {
+  constexpr int kPerWord = 4 / static_cast<int>(sizeof(Pixel));
+  if (x0 >= x1) {
+    return;
+  }
+  for (; (x0 % kPerWord) != 0 && x0 < x1; ++x0) {
+    row[x0] = color;
+  }
+  const uint32_t word = color * (sizeof(Pixel) == 1 ? 0x01010101u : 0x00010001u);
+  for (; x0 + kPerWord <= x1; x0 += kPerWord) {
+    memcpy(row + x0, &word, sizeof(word));
+  }
+  for (; x0 < x1; ++x0) {
+    row[x0] = color;
+  }
+}
+
+// Canvas over a Pixel buffer whose storage can be swapped, for double
+// buffering. GFX colours are RGB565 and are mapped through toPixel().
+// Rectangles, lines and triangles are clipped once and then written without
+// per-pixel bounds checks; text and other GFX shapes fall back to these.
+class FrameCanvas : public Adafruit_GFX {
+ public:
+  FrameCanvas(uint16_t w, uint16_t h);
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override;
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override;
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+  void fillScreen(uint16_t color) override;
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) override;
+  // Hides Adafruit_GFX::fillTriangle: one clipped span per row.
+  void fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color);
+
+  Pixel *getBuffer() const { return buffer_; }
+  void setBuffer(Pixel *pixels) { buffer_ = pixels; }
+  // Clips drawing to the top-left w x h; the row stride stays the full width.
+  void setViewport(int16_t w, int16_t h) {
+    _width = w;
+    _height = h;
+  }
+
+ private:
+  Pixel *buffer_;
+  int16_t stride_;
+};
+
 struct Vec3 {
   float x;
   float y;
@@ -79,7 +239,7 @@ struct ProjVert {
 struct FaceQuad {
   ProjVert p[4];
   float depth;
-  uint16_t color;
+  Pixel color;
 };
 
 struct KeyBinding {
@@ -126,12 +286,16 @@ struct RayHit {
 };
 
 extern Adafruit_ST7735 tft;
-extern GFXcanvas16 canvas;
+extern FrameCanvas canvas;
 extern WebServer server;
 
 extern uint8_t s_voxel[kWorldW][kWorldHMax][kWorldD];
+// Bumped on every change to s_voxel.
+extern uint32_t s_worldVersion;
 extern FaceQuad s_faces[kMaxFaces];
 extern int s_faceCount;
+// Far-to-near draw order, as indices into s_faces.
+extern uint16_t s_faceOrder[kMaxFaces];
 
 extern float s_camX;
 extern float s_camY;
@@ -147,12 +311,30 @@ extern float s_camSp;
 extern unsigned long s_lastFpsMs;
 extern unsigned long s_lastFrameMs;
 extern uint32_t s_frameCounter;
+extern uint32_t s_skipCounter;
+// Frames rendered and frames skipped as idle over the last second.
 extern uint16_t s_fps;
+extern uint16_t s_fpsSkipped;
+extern uint32_t s_statSortUs;
+extern uint32_t s_statRasterUs;
+// Written by the present task; read and reset with exchange(0).
+extern std::atomic<uint32_t> s_statPresentUs;
+extern std::atomic<uint32_t> s_statPresentBytes;
+extern uint32_t s_statPresentWaitUs;
+// Render governor state (see kAdaptiveRadius and kDynamicResolution).
+extern float s_renderRadius;
+extern int s_faceBudget;
+// Runtime ceiling on s_faceBudget (see setFaceBudgetCap()).
+extern int s_faceBudgetCap;
+extern float s_frameUsAvg;
+extern const char *s_governorNote;
+extern uint8_t s_viewScale;
+extern int s_viewW;
+extern int s_viewH;
 
 extern unsigned long s_lastWifiAttemptMs;
 extern unsigned long s_lastInputMs;
 extern unsigned long s_lastEditMs;
-extern unsigned long s_lastMcAttemptMs;
 extern bool s_prevJumpDown;
 extern bool s_prevBreakDown;
 extern bool s_prevPlaceDown;
@@ -4,6 +4,8 @@
 
 namespace game {
 
+// Starts the network task (see kMcClientTask). Call once after setup.
+void mcBegin();
 void mcSetConfig(const String &host, uint16_t port, const String &playerName, bool autoConnect);
 void mcForceReconnect();
 void mcUpdate();
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "game_shared.h"
+
+namespace game {
+
+// Exposed-face bits per voxel. Bottom faces are never drawn by the renderer.
+enum FaceBit : uint8_t {
+  FACE_TOP = 1 << 0,
+  FACE_NORTH = 1 << 1,  // -Z
+  FACE_SOUTH = 1 << 2,  // +Z
+  FACE_WEST = 1 << 3,   // -X
+  FACE_EAST = 1 << 4,   // +X
+};
+
+inline constexpr int kBrickSize = 4;
+inline constexpr int kBricksX = kWorldW / kBrickSize;
+inline constexpr int kBricksY = (kWorldHMax + kBrickSize - 1) / kBrickSize;
+inline constexpr int kBricksZ = kWorldD / kBrickSize;
+inline constexpr int kMeshQuadCap = 2048;
+
+// Greedy-merged face rectangle. du/dv run along x/z for top faces, x/y for
+// north/south faces and z/y for west/east faces.
+struct MeshQuad {
+  uint8_t x;
+  uint8_t y;
+  uint8_t z;
+  uint8_t dir;
+  uint8_t du;
+  uint8_t dv;
+  uint16_t color;
+};
+
+struct BrickMesh {
+  uint16_t first;
+  uint16_t count;
+  // The quad pool had no room for this brick; draw it from s_faceMask.
+  bool unitFaces;
+};
+
+// World-space face cache: which faces of each voxel touch air, plus the
+// y-range of each column that has any exposed face (-1 when empty).
+extern uint8_t s_faceMask[kWorldW][kWorldHMax][kWorldD];
+extern int8_t s_colFaceMinY[kWorldW][kWorldD];
+extern int8_t s_colFaceMaxY[kWorldW][kWorldD];
+// Top of the unbroken solid run starting at y = 0 (-1 when y = 0 is air).
+// Used as a conservative occluder by the horizon pass.
+extern int8_t s_colGroundTop[kWorldW][kWorldD];
+// Highest solid voxel of each column (-1 when empty): the far-LOD heightmap.
+extern int8_t s_colSurfaceY[kWorldW][kWorldD];
+
+// Merged quads of every 4x4x4 brick, stored contiguously in brick order.
+extern MeshQuad s_meshQuads[kMeshQuadCap];
+extern int s_meshQuadCount;
+extern BrickMesh s_brickMesh[kBricksX][kBricksY][kBricksZ];
+// Bricks currently drawn as unit faces because the pool overflowed.
+extern int s_meshOverflowBricks;
+
+void meshInvalidateAll();
+void meshVoxelChanged(int x, int y, int z);
+void meshUpdate();
+
+}  // namespace game
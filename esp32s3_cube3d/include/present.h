@@ -0,0 +1,39 @@
+#pragma once
+
+#include "game_shared.h"
+
+namespace game {
+
+// Destination for finished frames. The default sink drives the ST7735; a
+// mock can be installed with presentSetSink() to count transferred bytes.
+class DisplaySink {
+ public:
+  virtual ~DisplaySink() = default;
+  // Sends the w x h rectangle at (x, y); `pixels` points at its top-left
+  // framebuffer pixel and rows are `stride` pixels apart.
+  virtual void pushRect(int x, int y, int w, int h, const Pixel *pixels, int stride) = 0;
+};
+
+inline constexpr int kPresentTile = 16;
+inline constexpr int kPresentTilesX = kScreenW / kPresentTile;
+inline constexpr int kPresentTilesY = kScreenH / kPresentTile;
+
+// Starts the present task when kAsyncPresent is set. Call once the panel
+// is initialised; from then on only the present stage touches `tft`.
+void presentBegin();
+// Waits for the in-flight frame (if any) and installs a new sink.
+void presentSetSink(DisplaySink *sink);
+// Forces the next presented frame to send every tile.
+void presentInvalidate();
+// Sends only the tiles of `fb` whose content changed since the last call.
+// Synchronous; normally reached through presentSwap().
+void presentFrame(const Pixel *fb);
+
+// Hands the finished canvas to the present stage and points the canvas at
+// the other buffer. Blocks only while the previous frame is still being
+// sent, so that buffer is free to render into.
+void presentSwap();
+// Fence: returns once every submitted frame is on the panel.
+void presentWait();
+
+}  // namespace game
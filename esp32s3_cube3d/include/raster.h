@@ -0,0 +1,20 @@
+#pragma once
+
+#include "game_shared.h"
+
+namespace game {
+
+// Starts the tiled-raster helper task (kParallelRaster). Until then the
+// caller draws every tile itself.
+void rasterBegin();
+// Copies the sky / ground-fog backdrop over the whole view.
+void rasterClearView();
+void rasterFacesFrontToBack();
+void rasterFacesDepthTested();
+void rasterFacesTiled();
+// Fills one convex face straight into the canvas buffer (painter mode).
+void rasterFillQuad(const FaceQuad &f);
+// Inclusive, screen-clipped rectangle tested against the depth buffer.
+void rasterDepthRect(int x0, int y0, int x1, int y1, float cz, uint16_t color);
+
+}  // namespace game
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "game_shared.h"
+
+namespace game {
+
+// Column raycaster over s_voxel: clears and fills the whole world view.
+void raycastWorld();
+
+}  // namespace game
@@ -6,8 +6,19 @@ namespace game {
 
 void updateCameraBasis();
 bool projectToScreen(const Vec3 &w, ProjVert &out);
+// Both projection paths, regardless of kFixedPointProjection (for benchmarks).
+bool projectToScreenFloat(const Vec3 &w, ProjVert &out);
+bool projectToScreenFixed(const Vec3 &w, ProjVert &out);
 void buildVisibleFaces();
 void drawWorld();
+// Either engine, regardless of kRenderEngine (for benchmarks).
+void drawWorldWith(RenderEngine engine);
+// Feeds the render governor (radius, then resolution) one frame's render
+// time in microseconds, present excluded.
+void renderGovernorUpdate(unsigned long frameUs);
+// Caps the per-frame face count, clamped to [kFaceBudgetMin, kMaxFaces].
+// Faces are emitted nearest first, so a low cap trims distant geometry.
+void setFaceBudgetCap(int cap);
 void drawHud();
 void drawHomeScreen();
 void drawCrosshair();
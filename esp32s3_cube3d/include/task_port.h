@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace game {
+
+// Binary semaphore: FreeRTOS on the device, mutex + condvar on a host build.
+class TaskSignal {
+ public:
+  void begin(bool given) {
+#if defined(ESP_PLATFORM)
+    handle_ = xSemaphoreCreateBinary();
+    if (given) {
+      xSemaphoreGive(handle_);
+    }
+#else
+    given_ = given;
+#endif
+  }
+
+  void give() {
+#if defined(ESP_PLATFORM)
+    xSemaphoreGive(handle_);
+#else
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      given_ = true;
+    }
+    cv_.notify_one();
+#endif
+  }
+
+  void take() {
+#if defined(ESP_PLATFORM)
+    xSemaphoreTake(handle_, portMAX_DELAY);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return given_; });
+    given_ = false;
+#endif
+  }
+
+ private:
+#if defined(ESP_PLATFORM)
+  SemaphoreHandle_t handle_ = nullptr;
+#else
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool given_ = false;
+#endif
+};
+
+// Starts fn(arg) as a long-running task pinned to `core` at FreeRTOS
+// `priority` (both ignored on a host build, where it becomes a detached
+// std::thread).
+inline void taskSpawn(const char *name, void (*fn)(void *), void *arg, uint32_t stackBytes, int core,
+                      int priority = 1) {
+#if defined(ESP_PLATFORM)
+  xTaskCreatePinnedToCore(fn, name, stackBytes, arg, priority, nullptr, core);
+#else
+  (void)name;
+  (void)stackBytes;
+  (void)core;
+  (void)priority;
+  std::thread(fn, arg).detach();
+#endif
+}
+
+}  // namespace game
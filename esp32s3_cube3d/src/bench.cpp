@@ -0,0 +1,207 @@
+#include "bench.h"
+
+#include "raster.h"
+#include "rendering.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace game {
+
+namespace {
+
+constexpr int kBenchReps = 4;
+constexpr int kEnginePoses = 8;
+
+// Every lattice corner of the voxel window, i.e. the vertices faces use.
+template <typename Fn>
+void forEachLatticeVertex(Fn fn) {
+  for (int x = 0; x <= kWorldW; ++x) {
+    for (int y = 0; y <= kWorldHMax; ++y) {
+      for (int z = 0; z <= kWorldD; ++z) {
+        fn(Vec3{static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)});
+      }
+    }
+  }
+}
+
+template <bool (*Project)(const Vec3 &, ProjVert &)>
+unsigned long timeProjection(int *visible) {
+  volatile int32_t sink = 0;
+  int count = 0;
+  const unsigned long startUs = micros();
+  for (int rep = 0; rep < kBenchReps; ++rep) {
+    count = 0;
+    forEachLatticeVertex([&](const Vec3 &v) {
+      ProjVert p;
+      if (Project(v, p)) {
+        sink = sink + p.sx + p.sy;
+        count++;
+      }
+    });
+  }
+  *visible = count;
+  return micros() - startUs;
+}
+
+// Draws the world with one engine from the current position at
+// kEnginePoses evenly spaced headings, kBenchReps times each.
+unsigned long timeEngine(RenderEngine engine, int *maxFaces) {
+  const float savedYaw = s_yaw;
+  const unsigned long startUs = micros();
+  for (int pose = 0; pose < kEnginePoses; ++pose) {
+    s_yaw = savedYaw + static_cast<float>(pose) * (6.2831853f / kEnginePoses);
+    updateCameraBasis();
+    for (int rep = 0; rep < kBenchReps; ++rep) {
+      drawWorldWith(engine);
+    }
+    *maxFaces = std::max(*maxFaces, s_faceCount);
+  }
+  const unsigned long elapsedUs = micros() - startUs;
+  s_yaw = savedYaw;
+  updateCameraBasis();
+  return elapsedUs;
+}
+
+// Fills the recorded face list in painter order with one filler and
+// returns the elapsed time of kBenchReps passes.
+unsigned long timeFaceFill(bool nativeQuad) {
+  const unsigned long startUs = micros();
+  for (int rep = 0; rep < kBenchReps; ++rep) {
+    for (int i = 0; i < s_faceCount; ++i) {
+      const FaceQuad &f = s_faces[s_faceOrder[i]];
+      if (nativeQuad) {
+        rasterFillQuad(f);
+      } else {
+        // The GFX base filler, not FrameCanvas's own span version.
+        const uint16_t rgb = pixelRgb(f.color);
+        canvas.Adafruit_GFX::fillTriangle(f.p[0].sx, f.p[0].sy, f.p[1].sx, f.p[1].sy, f.p[2].sx, f.p[2].sy, rgb);
+        canvas.Adafruit_GFX::fillTriangle(f.p[0].sx, f.p[0].sy, f.p[2].sx, f.p[2].sy, f.p[3].sx, f.p[3].sy, rgb);
+      }
+    }
+  }
+  return micros() - startUs;
+}
+
+}  // namespace
+
+String benchProjectionJson() {
+  int visibleFloat = 0;
+  int visibleFixed = 0;
+  const unsigned long floatUs = timeProjection<projectToScreenFloat>(&visibleFloat);
+  const unsigned long fixedUs = timeProjection<projectToScreenFixed>(&visibleFixed);
+
+  // Accuracy of the fixed path against the float reference.
+  int maxErr = 0;
+  int overOnePx = 0;
+  int clipMismatch = 0;
+  forEachLatticeVertex([&](const Vec3 &v) {
+    ProjVert a;
+    ProjVert b;
+    const bool okA = projectToScreenFloat(v, a);
+    const bool okB = projectToScreenFixed(v, b);
+    if (okA != okB) {
+      clipMismatch++;
+      return;
+    }
+    if (!okA) {
+      return;
+    }
+    const int err = std::max(abs(a.sx - b.sx), abs(a.sy - b.sy));
+    maxErr = std::max(maxErr, err);
+    if (err > 1) {
+      overOnePx++;
+    }
+  });
+
+  const int verts = (kWorldW + 1) * (kWorldHMax + 1) * (kWorldD + 1);
+  String out;
+  out.reserve(256);
+  out += "{\"ok\":true,\"bench\":\"proj\",";
+  out += "\"verts\":";
+  out += String(verts * kBenchReps);
+  out += ",\"visible_float\":";
+  out += String(visibleFloat);
+  out += ",\"visible_fixed\":";
+  out += String(visibleFixed);
+  out += ",\"float_us\":";
+  out += String(floatUs);
+  out += ",\"fixed_us\":";
+  out += String(fixedUs);
+  out += ",\"active\":\"";
+  out += kFixedPointProjection ? "fixed" : "float";
+  out += "\",\"max_err_px\":";
+  out += String(maxErr);
+  out += ",\"err_over_1px\":";
+  out += String(overOnePx);
+  out += ",\"clip_mismatch\":";
+  out += String(clipMismatch);
+  out += "}";
+  return out;
+}
+
+String benchEngineJson() {
+  // Keep the benchmark out of the per-second [stat] averages.
+  const uint32_t savedSortUs = s_statSortUs;
+  const uint32_t savedRasterUs = s_statRasterUs;
+  int maxFaces = 0;
+  const unsigned long polygonUs = timeEngine(ENGINE_POLYGON, &maxFaces);
+  int ignored = 0;
+  const unsigned long raycastUs = timeEngine(ENGINE_RAYCAST, &ignored);
+  s_statSortUs = savedSortUs;
+  s_statRasterUs = savedRasterUs;
+
+  const int frames = kEnginePoses * kBenchReps;
+  String out;
+  out.reserve(192);
+  out += "{\"ok\":true,\"bench\":\"engine\",";
+  out += "\"frames\":";
+  out += String(frames);
+  out += ",\"max_faces\":";
+  out += String(maxFaces);
+  out += ",\"polygon_us\":";
+  out += String(polygonUs / frames);
+  out += ",\"raycast_us\":";
+  out += String(raycastUs / frames);
+  out += ",\"active\":\"";
+  out += (kRenderEngine == ENGINE_RAYCAST) ? "raycast" : "polygon";
+  out += "\"}";
+  return out;
+}
+
+String benchQuadFillJson() {
+  const uint32_t savedSortUs = s_statSortUs;
+  const float savedYaw = s_yaw;
+  unsigned long triangleUs = 0;
+  unsigned long quadUs = 0;
+  long faces = 0;
+  canvas.setViewport(s_viewW, s_viewH);
+  for (int pose = 0; pose < kEnginePoses; ++pose) {
+    s_yaw = savedYaw + static_cast<float>(pose) * (6.2831853f / kEnginePoses);
+    updateCameraBasis();
+    buildVisibleFaces();
+    faces += s_faceCount;
+    triangleUs += timeFaceFill(false);
+    quadUs += timeFaceFill(true);
+  }
+  canvas.setViewport(kScreenW, kScreenH);
+  s_yaw = savedYaw;
+  updateCameraBasis();
+  s_statSortUs = savedSortUs;
+
+  String out;
+  out.reserve(160);
+  out += "{\"ok\":true,\"bench\":\"quad\",";
+  out += "\"faces\":";
+  out += String(faces * kBenchReps);
+  out += ",\"triangle_us\":";
+  out += String(triangleUs);
+  out += ",\"quad_us\":";
+  out += String(quadUs);
+  out += ",\"active\":\"";
+  out += kNativeQuadFill ? "quad" : "triangle";
+  out += "\"}";
+  return out;
+}
+
+}  // namespace game
@@ -165,7 +165,6 @@ void updateCamera(float dtSec) {
   } else if (s_yaw < -static_cast<float>(M_PI)) {
     s_yaw += static_cast<float>(M_PI) * 2.0f;
   }
-  updateCameraBasis();
 
   float forward = 0.0f;
   if (actionDown("move_fwd")) {
@@ -193,8 +192,10 @@ void updateCamera(float dtSec) {
       strafe /= len;
     }
     const float step = kMoveSpeed * dtSec;
-    const float moveX = (s_camSy * forward + s_camCy * strafe) * step;
-    const float moveZ = (s_camCy * forward - s_camSy * strafe) * step;
+    const float cy = cosf(s_yaw);
+    const float sy = sinf(s_yaw);
+    const float moveX = (sy * forward + cy * strafe) * step;
+    const float moveZ = (cy * forward - sy * strafe) * step;
 
     const bool currentlyColliding = isPlayerCollidingAt(s_camX, s_camY, s_camZ);
     bool movedXZ = false;
@@ -288,6 +289,8 @@ void updateCamera(float dtSec) {
     // Keep server Y stable in streamed online mode to avoid desync drift.
     s_velY = 0.0f;
   }
+  // Once the position has settled, so the fixed-point camera is current.
+  updateCameraBasis();
 
   const bool breakDown = actionDown("break_block");
   const bool placeDown = actionDown("place_block");
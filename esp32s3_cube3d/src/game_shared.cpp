@@ -1,14 +1,75 @@
 #include "game_shared.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 namespace game {
 
+namespace {
+
+// Open-addressed RGB565 -> palette index map, twice the palette size so
+// probe runs stay short.
+constexpr int kPaletteSlots = 512;
+uint16_t s_paletteKey[kPaletteSlots];
+uint8_t s_paletteValue[kPaletteSlots];
+bool s_paletteUsed[kPaletteSlots];
+int s_paletteCount = 0;
+bool s_paletteFullLogged = false;
+// kHudKey always owns this index, so no other colour can match it.
+constexpr int kHudKeyIndex = 0;
+
+int channelDistance(uint16_t a, uint16_t b) {
+  const int dr = ((a >> 11) & 0x1F) - ((b >> 11) & 0x1F);
+  const int dg = (((a >> 5) & 0x3F) - ((b >> 5) & 0x3F)) / 2;
+  const int db = (a & 0x1F) - (b & 0x1F);
+  return dr * dr + dg * dg + db * db;
+}
+
+uint8_t nearestPaletteEntry(uint16_t rgb) {
+  int best = kHudKeyIndex + 1;
+  int bestDist = INT32_MAX;
+  for (int i = 0; i < s_paletteCount; ++i) {
+    if (i == kHudKeyIndex) {
+      continue;
+    }
+    const int d = channelDistance(rgb, s_palette[i]);
+    if (d < bestDist) {
+      best = i;
+      bestDist = d;
+    }
+  }
+  return static_cast<uint8_t>(best);
+}
+
+// Map slot holding `rgb`, or the empty slot that ends its probe run.
+int findPaletteSlot(uint16_t rgb) {
+  int slot = static_cast<int>((rgb * 40503u) >> 7) & (kPaletteSlots - 1);
+  while (s_paletteUsed[slot] && s_paletteKey[slot] != rgb) {
+    slot = (slot + 1) & (kPaletteSlots - 1);
+  }
+  return slot;
+}
+
+uint8_t addPaletteEntry(int slot, uint16_t rgb) {
+  const uint8_t index = static_cast<uint8_t>(s_paletteCount++);
+  s_palette[index] = rgb;
+  s_paletteKey[slot] = rgb;
+  s_paletteValue[slot] = index;
+  s_paletteUsed[slot] = true;
+  return index;
+}
+
+}  // namespace
+
 Adafruit_ST7735 tft(kTftCs, kTftDc, kTftRst);
-GFXcanvas16 canvas(kScreenW, kScreenH);
+FrameCanvas canvas(kScreenW, kScreenH);
 WebServer server(80);
 
 uint8_t s_voxel[kWorldW][kWorldHMax][kWorldD];
+uint32_t s_worldVersion = 0;
 FaceQuad s_faces[kMaxFaces];
 int s_faceCount = 0;
+uint16_t s_faceOrder[kMaxFaces];
 
 float s_camX = (kWorldW - 1) * 0.5f;
 float s_camY = 4.2f;
@@ -24,12 +85,26 @@ float s_camSp = 0.0f;
 unsigned long s_lastFpsMs = 0;
 unsigned long s_lastFrameMs = 0;
 uint32_t s_frameCounter = 0;
+uint32_t s_skipCounter = 0;
 uint16_t s_fps = 0;
+uint16_t s_fpsSkipped = 0;
+uint32_t s_statSortUs = 0;
+uint32_t s_statRasterUs = 0;
+std::atomic<uint32_t> s_statPresentUs{0};
+std::atomic<uint32_t> s_statPresentBytes{0};
+uint32_t s_statPresentWaitUs = 0;
+float s_renderRadius = kRenderRadius;
+int s_faceBudget = kMaxFaces;
+int s_faceBudgetCap = kMaxFaces;
+float s_frameUsAvg = 0.0f;
+const char *s_governorNote = "steady";
+uint8_t s_viewScale = kViewScaleFull;
+int s_viewW = kScreenW;
+int s_viewH = kScreenH;
 
 unsigned long s_lastWifiAttemptMs = 0;
 unsigned long s_lastInputMs = 0;
 unsigned long s_lastEditMs = 0;
-unsigned long s_lastMcAttemptMs = 0;
 bool s_prevJumpDown = false;
 bool s_prevBreakDown = false;
 bool s_prevPlaceDown = false;
@@ -73,6 +148,197 @@ String s_mcPlayerName = kMcDefaultPlayer;
 bool s_mcAutoConnect = true;
 String s_mcState = "IDLE";
 
+uint16_t s_palette[256];
+
+uint8_t paletteIndex(uint16_t rgb) {
+  if (s_paletteCount == 0) {
+    addPaletteEntry(findPaletteSlot(kHudKey), kHudKey);
+  }
+  const int slot = findPaletteSlot(rgb);
+  if (s_paletteUsed[slot]) {
+    return s_paletteValue[slot];
+  }
+  if (s_paletteCount == 256) {
+    if (!s_paletteFullLogged) {
+      s_paletteFullLogged = true;
+      Serial.printf("[palette] all 256 entries used, 0x%04X and later colours map to the nearest entry\n", rgb);
+    }
+    // Not cached, so the map never holds more than 256 keys.
+    return nearestPaletteEntry(rgb);
+  }
+  return addPaletteEntry(slot, rgb);
+}
+
+FrameCanvas::FrameCanvas(uint16_t w, uint16_t h)
+    : Adafruit_GFX(w, h),
+      buffer_(static_cast<Pixel *>(calloc(static_cast<size_t>(w) * h, sizeof(Pixel)))),
+      stride_(static_cast<int16_t>(w)) {}
+
+void FrameCanvas::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) {
+    return;
+  }
+  buffer_[y * stride_ + x] = toPixel(color);
+}
+
+void FrameCanvas::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+  fillRect(x, y, w, 1, color);
+}
+
+void FrameCanvas::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+  fillRect(x, y, 1, h, color);
+}
+
+void FrameCanvas::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  if (w < 0) {
+    x += w + 1;
+    w = -w;
+  }
+  if (h < 0) {
+    y += h + 1;
+    h = -h;
+  }
+  const int x0 = std::max<int>(0, x);
+  const int y0 = std::max<int>(0, y);
+  const int x1 = std::min<int>(_width, x + w);
+  const int y1 = std::min<int>(_height, y + h);
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+  const Pixel px = toPixel(color);
+  for (int row = y0; row < y1; ++row) {
+    fillRow(buffer_ + row * stride_, x0, x1, px);
+  }
+}
+
+void FrameCanvas::fillScreen(uint16_t color) {
+  fillRect(0, 0, _width, _height, color);
+}
+
+void FrameCanvas::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  if (x0 == x1 || y0 == y1) {
+    fillRect(std::min(x0, x1), std::min(y0, y1), std::abs(x1 - x0) + 1, std::abs(y1 - y0) + 1, color);
+    return;
+  }
+  // Cohen-Sutherland against the viewport, so Bresenham below stays inside.
+  const int xMax = _width - 1;
+  const int yMax = _height - 1;
+  auto outCode = [&](int x, int y) {
+    return (x < 0 ? 1 : 0) | (x > xMax ? 2 : 0) | (y < 0 ? 4 : 0) | (y > yMax ? 8 : 0);
+  };
+  int ax = x0;
+  int ay = y0;
+  int bx = x1;
+  int by = y1;
+  int codeA = outCode(ax, ay);
+  int codeB = outCode(bx, by);
+  while ((codeA | codeB) != 0) {
+    if ((codeA & codeB) != 0) {
+      return;
+    }
+    const int code = (codeA != 0) ? codeA : codeB;
+    const int64_t dx = bx - ax;
+    const int64_t dy = by - ay;
+    int x = 0;
+    int y = 0;
+    if (code & 8) {
+      y = yMax;
+      x = ax + static_cast<int>(dx * (yMax - ay) / dy);
+    } else if (code & 4) {
+      y = 0;
+      x = ax + static_cast<int>(dx * -ay / dy);
+    } else if (code & 2) {
+      x = xMax;
+      y = ay + static_cast<int>(dy * (xMax - ax) / dx);
+    } else {
+      x = 0;
+      y = ay + static_cast<int>(dy * -ax / dx);
+    }
+    if (code == codeA) {
+      ax = x;
+      ay = y;
+      codeA = outCode(ax, ay);
+    } else {
+      bx = x;
+      by = y;
+      codeB = outCode(bx, by);
+    }
+  }
+
+  const Pixel px = toPixel(color);
+  const int dx = std::abs(bx - ax);
+  const int dy = -std::abs(by - ay);
+  const int sx = (ax < bx) ? 1 : -1;
+  const int step = (ay < by) ? stride_ : -stride_;
+  Pixel *p = buffer_ + ay * stride_ + ax;
+  int err = dx + dy;
+  for (;;) {
+    *p = px;
+    if (ax == bx && ay == by) {
+      return;
+    }
+    const int e2 = 2 * err;
+    if (e2 >= dy) {
+      err += dy;
+      ax += sx;
+      p += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      ay += (step > 0) ? 1 : -1;
+      p += step;
+    }
+  }
+}
+
+void FrameCanvas::fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+                               uint16_t color) {
+  if (y0 > y1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+  if (y1 > y2) {
+    std::swap(x1, x2);
+    std::swap(y1, y2);
+  }
+  if (y0 > y1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+  if (y2 < 0 || y0 >= _height) {
+    return;
+  }
+  const Pixel px = toPixel(color);
+  if (y0 == y2) {
+    const int a = std::max<int>(0, std::min(x0, std::min(x1, x2)));
+    const int b = std::min<int>(_width - 1, std::max(x0, std::max(x1, x2))) + 1;
+    fillRow(buffer_ + y0 * stride_, a, b, px);
+    return;
+  }
+
+  // 16.16 x along the long edge (0-2) and the short edges (0-1, then 1-2).
+  const int yStart = std::max<int>(0, y0);
+  const int yEnd = std::min<int>(_height - 1, y2);
+  const int64_t slopeLong = static_cast<int64_t>(x2 - x0) * 65536 / (y2 - y0);
+  const int64_t slopeUpper = (y1 > y0) ? static_cast<int64_t>(x1 - x0) * 65536 / (y1 - y0) : 0;
+  const int64_t slopeLower = (y2 > y1) ? static_cast<int64_t>(x2 - x1) * 65536 / (y2 - y1) : 0;
+  int64_t xLong = static_cast<int64_t>(x0) * 65536 + slopeLong * (yStart - y0) + 0x8000;
+  Pixel *row = buffer_ + yStart * stride_;
+  for (int y = yStart; y <= yEnd; ++y, row += stride_) {
+    // The row at y1 belongs to the upper edge only when there is no lower one.
+    const int64_t xShort = (y < y1 || y1 == y2)
+                               ? static_cast<int64_t>(x0) * 65536 + slopeUpper * (y - y0) + 0x8000
+                               : static_cast<int64_t>(x1) * 65536 + slopeLower * (y - y1) + 0x8000;
+    int a = static_cast<int>(xLong >> 16);
+    int b = static_cast<int>(xShort >> 16);
+    if (a > b) {
+      std::swap(a, b);
+    }
+    fillRow(row, std::max(0, a), std::min<int>(_width - 1, b) + 1, px);
+    xLong += slopeLong;
+  }
+}
+
 const char *blockShortName(uint8_t blockId) {
   switch (blockId) {
     case BLOCK_GRASS:
@@ -3,12 +3,15 @@
 #include "controls.h"
 #include "game_shared.h"
 #include "mc_client.h"
+#include "present.h"
+#include "raster.h"
 #include "rendering.h"
 #include "web_control.h"
 #include "world.h"
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
 using namespace game;
 
@@ -16,6 +19,50 @@ namespace {
 
 bool s_prevGameplayReady = false;
 
+// Everything a gameplay frame is drawn from. Compared bytewise, so it is
+// always zeroed before being filled in.
+struct FrameInputs {
+  float camX;
+  float camY;
+  float camZ;
+  float yaw;
+  float pitch;
+  uint32_t worldVersion;
+  RayHit aimHit;
+  bool hasAimHit;
+  uint16_t fps;
+  int selectedSlot;
+  HotbarSlot hotbar[kInvSlots];
+  RemotePlayerView remotePlayers[kRemotePlayerMax];
+  float renderRadius;
+  int faceBudget;
+  uint8_t viewScale;
+};
+
+FrameInputs s_lastDrawn;
+bool s_lastDrawnValid = false;
+
+void captureFrameInputs(FrameInputs *in) {
+  memset(in, 0, sizeof(*in));
+  in->camX = s_camX;
+  in->camY = s_camY;
+  in->camZ = s_camZ;
+  in->yaw = s_yaw;
+  in->pitch = s_pitch;
+  in->worldVersion = s_worldVersion;
+  in->hasAimHit = s_hasAimHit;
+  if (s_hasAimHit) {
+    memcpy(&in->aimHit, &s_aimHit, sizeof(s_aimHit));
+  }
+  in->fps = s_fps;
+  in->selectedSlot = s_selectedSlot;
+  memcpy(in->hotbar, s_hotbar, sizeof(in->hotbar));
+  memcpy(in->remotePlayers, s_remotePlayers, sizeof(in->remotePlayers));
+  in->renderRadius = s_renderRadius;
+  in->faceBudget = s_faceBudget;
+  in->viewScale = s_viewScale;
+}
+
 void resetActionLatch() {
   clearAllActions();
   s_prevJumpDown = false;
@@ -30,12 +77,26 @@ void resetActionLatch() {
 }
 
 void tickFpsAndLog(unsigned long now) {
-  s_frameCounter++;
   if (now - s_lastFpsMs >= 1000) {
     s_fps = s_frameCounter;
+    s_fpsSkipped = s_skipCounter;
+    const uint32_t frames = std::max<uint32_t>(1, s_frameCounter);
+    const uint32_t presentUs = s_statPresentUs.exchange(0);
+    const uint32_t presentBytes = s_statPresentBytes.exchange(0);
     s_frameCounter = 0;
+    s_skipCounter = 0;
     s_lastFpsMs = now;
-    Serial.printf("[stat] fps=%u pos=(%.2f,%.2f,%.2f)\n", s_fps, s_camX, s_camY, s_camZ);
+    Serial.printf("[stat] fps=%u skipped=%u pos=(%.2f,%.2f,%.2f) faces=%d sort_us=%lu raster_us=%lu present_us=%lu "
+                  "present_bytes=%lu present_wait_us=%lu radius=%.0f view=%dx%d\n",
+                  s_fps, s_fpsSkipped, s_camX, s_camY, s_camZ, s_faceCount, static_cast<unsigned long>(s_statSortUs / frames),
+                  static_cast<unsigned long>(s_statRasterUs / frames),
+                  static_cast<unsigned long>(presentUs / frames),
+                  static_cast<unsigned long>(presentBytes / frames),
+                  static_cast<unsigned long>(s_statPresentWaitUs / frames), s_renderRadius, s_viewW,
+                  s_viewH);
+    s_statSortUs = 0;
+    s_statRasterUs = 0;
+    s_statPresentWaitUs = 0;
   }
 }
 
@@ -57,6 +118,9 @@ void setup() {
   tft.setSPISpeed(24000000);
   tft.setRotation(1);
   tft.fillScreen(ST77XX_BLACK);
+  presentInvalidate();
+  presentBegin();
+  rasterBegin();
 
   clearWorld();
   s_gameStarted = true;
@@ -64,6 +128,7 @@ void setup() {
   s_selectedSlot = 0;
   wifiConnectNow();
   setupWeb();
+  mcBegin();
 
   s_lastInputMs = millis();
   s_lastFpsMs = millis();
@@ -77,7 +142,8 @@ void loop() {
   checkInputTimeout();
 
   const unsigned long now = millis();
-  const float dt = static_cast<float>(now - s_lastFrameMs) * 0.001f;
+  const unsigned long frameMs = now - s_lastFrameMs;
+  const float dt = static_cast<float>(frameMs) * 0.001f;
   s_lastFrameMs = now;
 
   if (!mcReadyForGameplay()) {
@@ -85,8 +151,10 @@ void loop() {
       s_prevGameplayReady = false;
       resetActionLatch();
     }
+    s_lastDrawnValid = false;
     drawHomeScreen();
-    tft.drawRGBBitmap(0, 0, canvas.getBuffer(), kScreenW, kScreenH);
+    presentSwap();
+    s_frameCounter++;
     tickFpsAndLog(now);
     return;
   }
@@ -97,11 +165,28 @@ void loop() {
   }
 
   updateCamera(dt);
+
+  FrameInputs inputs;
+  captureFrameInputs(&inputs);
+  if (kIdleFrameSkip && s_lastDrawnValid && memcmp(&inputs, &s_lastDrawn, sizeof(inputs)) == 0) {
+    s_skipCounter++;
+    tickFpsAndLog(now);
+    delay(kIdleSleepMs);
+    return;
+  }
+  memcpy(&s_lastDrawn, &inputs, sizeof(inputs));
+  s_lastDrawnValid = true;
+
+  const unsigned long renderStartUs = micros();
   drawWorld();
   drawAimHighlight();
   drawHud();
   drawCrosshair();
-  tft.drawRGBBitmap(0, 0, canvas.getBuffer(), kScreenW, kScreenH);
+  // Only the render itself: network, web and the present wait are not
+  // something a smaller radius or view would fix.
+  renderGovernorUpdate(micros() - renderStartUs);
+  presentSwap();
 
+  s_frameCounter++;
   tickFpsAndLog(now);
 }
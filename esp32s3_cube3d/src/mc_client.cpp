@@ -1,11 +1,15 @@
 #include "mc_client.h"
 
+#include "mesh_cache.h"
+#include "spsc_queue.h"
+#include "task_port.h"
 #include "world.h"
 
 #include <ESP.h>
 #include <WiFi.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
 
@@ -13,6 +17,12 @@ namespace game {
 
 namespace {
 
+// The client runs in two halves. The network half owns the socket, the
+// protocol state machine and chunk decoding, and runs in its own task when
+// kMcClientTask is set. The game half lives on the render loop and is the
+// only side that touches camera, world and remote-player state. The halves
+// talk through the two queues below plus a triple-buffered voxel window.
+
 enum McStage : uint8_t {
   MC_IDLE = 0,
   MC_WAIT_LOGIN_SUCCESS = 1,
@@ -21,6 +31,77 @@ enum McStage : uint8_t {
   MC_PLAY = 4,
 };
 
+enum McEventType : uint8_t {
+  MC_EV_SESSION_RESET = 0,
+  MC_EV_SYNC_POSITION = 1,
+  MC_EV_CENTER_CHUNK = 2,
+  MC_EV_ENTITY_POS = 3,
+  MC_EV_ENTITY_REMOVE = 4,
+  MC_EV_WINDOW_READY = 5,
+};
+
+// Network -> game. Positions are in server coordinates.
+struct McEvent {
+  McEventType type;
+  int32_t id;
+  int32_t cx;
+  int32_t cz;
+  double x;
+  double y;
+  double z;
+};
+
+enum McCommandType : uint8_t {
+  MC_CMD_MOVE = 0,
+  MC_CMD_HELD_SLOT = 1,
+  MC_CMD_USE_ITEM_ON = 2,
+  MC_CMD_BREAK_BLOCK = 3,
+  MC_CMD_CONFIG = 4,
+  MC_CMD_RECONNECT = 5,
+};
+
+// Game -> network. Positions are already converted to server coordinates.
+struct McCommand {
+  McCommandType type;
+  uint8_t arg;  // on-ground flag, held slot, block face or auto-connect
+  uint16_t port;
+  float yaw;
+  float pitch;
+  double x;
+  double y;
+  double z;
+  int32_t bx;
+  int32_t by;
+  int32_t bz;
+  char host[64];
+  char name[17];
+};
+
+SpscQueue<McEvent, 64> s_events;
+SpscQueue<McCommand, 16> s_commands;
+
+// Entity position updates only take event slots above this reserve, so
+// session, sync, chunk and window events still fit while they back up.
+constexpr size_t kEventReserve = 16;
+
+// Chunk decoding writes into one of three windows; the game half copies
+// finished ones into s_voxel between frames so the renderer never sees a
+// half-decoded window. Of the other two, s_sharedWindow names the newest
+// published one (tagged kWindowFresh until taken) and the game half holds
+// the last one it took. Publishing and taking are single exchanges, so
+// neither side waits and a newer window always replaces an untaken one.
+uint8_t s_netWindows[3][kWorldW][kWorldHMax][kWorldD];
+constexpr uint8_t kWindowFresh = 0x4;
+std::atomic<uint8_t> s_sharedWindow{1};
+uint8_t s_decodeWindow = 0;  // network half
+uint8_t s_takenWindow = 2;   // game half
+
+std::atomic<bool> s_netInPlay{false};
+std::atomic<const char *> s_netStateText{"IDLE"};
+bool s_taskStarted = false;
+
+// ---- Network half --------------------------------------------------------
+
 WiFiClient s_mcSocket;
 McStage s_mcStage = MC_IDLE;
 
@@ -36,25 +117,29 @@ constexpr size_t kPacketHeadCap = 98304;
 uint8_t s_pktHead[kPacketHeadCap];
 size_t s_pktHeadLen = 0;
 
-bool s_haveServerAnchor = false;
-double s_serverBaseX = 0.0;
-double s_serverBaseY = 80.0;
-double s_serverBaseZ = 0.0;
-float s_localAnchorX = 0.0f;
-float s_localAnchorFeetY = 0.0f;
-float s_localAnchorZ = 0.0f;
+String s_netHost = kMcDefaultHost;
+uint16_t s_netPort = kMcDefaultPort;
+String s_netPlayerName = kMcDefaultPlayer;
+bool s_netAutoConnect = true;
+uint8_t s_netHeldSlot = 0;
+
 double s_serverFeetY = 80.0;
 int32_t s_centerChunkX = 0;
 int32_t s_centerChunkZ = 0;
 bool s_haveCenterChunk = false;
-bool s_haveRemoteWorld = false;
+// Set once this session has posted anything the game half must undo.
+bool s_sessionFed = false;
+// Set when an event the game half cannot do without was dropped; the next
+// netStep() tears the session down so both halves start over in sync.
+bool s_eventsLost = false;
+uint32_t s_eventDropCount = 0;
+unsigned long s_lastAttemptMs = 0;
 bool s_sentKnownPacksAck = false;
 bool s_sentConfigAck = false;
 uint32_t s_chunkRxCount = 0;
 uint32_t s_chunkApplyCount = 0;
 uint32_t s_chunkDropCount = 0;
 
-unsigned long s_lastMoveSendMs = 0;
 unsigned long s_lastWifiOkMs = 0;
 unsigned long s_stageSinceMs = 0;
 unsigned long s_lastRxMs = 0;
@@ -64,6 +149,32 @@ int32_t s_actionSequence = 1;
 constexpr size_t kPacketBufCap = 320;
 constexpr unsigned long kMcHandshakeIdleTimeoutMs = 12000;
 constexpr unsigned long kMcConfigIdleTimeoutMs = 45000;
+constexpr uint32_t kMcTaskStackBytes = 8192;
+
+// ---- Game half -----------------------------------------------------------
+
+bool s_haveServerAnchor = false;
+double s_serverBaseX = 0.0;
+double s_serverBaseY = 80.0;
+double s_serverBaseZ = 0.0;
+float s_localAnchorX = 0.0f;
+float s_localAnchorFeetY = 0.0f;
+float s_localAnchorZ = 0.0f;
+int32_t s_viewCenterChunkX = 0;
+int32_t s_viewCenterChunkZ = 0;
+bool s_haveViewCenterChunk = false;
+bool s_haveRemoteWorld = false;
+unsigned long s_lastMoveSendMs = 0;
+const char *s_shownStateText = nullptr;
+// Control commands waiting for room in s_commands, newest wins. They are
+// flushed in this order so a reconnect always follows its config.
+int s_pendingHeldSlot = -1;
+bool s_pendingConfig = false;
+McCommand s_pendingConfigCmd = {};
+bool s_pendingReconnect = false;
+
+void drainEvents();
+void drainCommands();
 
 void clearRemotePlayers() {
   for (int i = 0; i < kRemotePlayerMax; ++i) {
@@ -121,6 +232,155 @@ void removeRemotePlayer(int32_t entityId) {
   slot->active = false;
 }
 
+
+// Drops everything the game half derived from the network session.
+void resetGameSession() {
+  s_haveServerAnchor = false;
+  s_haveViewCenterChunk = false;
+  s_haveRemoteWorld = false;
+  clearRemotePlayers();
+  clearWorld();
+}
+
+void applyEvent(const McEvent &ev) {
+  switch (ev.type) {
+    case MC_EV_SESSION_RESET:
+      resetGameSession();
+      break;
+    case MC_EV_SYNC_POSITION: {
+      s_serverBaseX = ev.x;
+      s_serverBaseY = ev.y;
+      s_serverBaseZ = ev.z;
+      // Re-anchor local coordinates to keep collision and movement aligned
+      // with the streamed chunk window around the server's current position.
+      const float localFeetY = 3.0f;
+      s_camX = 7.5f;
+      s_camY = localFeetY + kEyeHeight;
+      s_camZ = 7.5f;
+      s_localAnchorX = s_camX;
+      s_localAnchorFeetY = localFeetY;
+      s_localAnchorZ = s_camZ;
+      s_haveServerAnchor = true;
+      Serial.printf("[mc] sync server=(%.2f,%.2f,%.2f) local_anchor=(%.2f,%.2f,%.2f)\n", s_serverBaseX,
+                    s_serverBaseY, s_serverBaseZ, s_localAnchorX, s_localAnchorFeetY, s_localAnchorZ);
+      break;
+    }
+    case MC_EV_CENTER_CHUNK: {
+      if (s_haveViewCenterChunk) {
+        const int32_t dCx = ev.cx - s_viewCenterChunkX;
+        const int32_t dCz = ev.cz - s_viewCenterChunkZ;
+        if (dCx != 0 || dCz != 0) {
+          const float shiftX = static_cast<float>(dCx * 16);
+          const float shiftZ = static_cast<float>(dCz * 16);
+          // Keep the player near the local window center while streaming chunks.
+          s_camX -= shiftX;
+          s_camZ -= shiftZ;
+          s_localAnchorX -= shiftX;
+          s_localAnchorZ -= shiftZ;
+          for (int i = 0; i < kRemotePlayerMax; ++i) {
+            if (!s_remotePlayers[i].active) {
+              continue;
+            }
+            s_remotePlayers[i].x -= shiftX;
+            s_remotePlayers[i].z -= shiftZ;
+          }
+          Serial.printf("[mc] center (%ld,%ld)->(%ld,%ld) shift=(%ld,%ld) cam=(%.2f,%.2f)\n",
+                        static_cast<long>(s_viewCenterChunkX), static_cast<long>(s_viewCenterChunkZ),
+                        static_cast<long>(ev.cx), static_cast<long>(ev.cz), static_cast<long>(dCx * 16),
+                        static_cast<long>(dCz * 16), s_camX, s_camZ);
+        }
+      }
+      s_viewCenterChunkX = ev.cx;
+      s_viewCenterChunkZ = ev.cz;
+      s_haveViewCenterChunk = true;
+      break;
+    }
+    case MC_EV_ENTITY_POS:
+      updateRemotePlayerFromServer(ev.id, ev.x, ev.y, ev.z);
+      break;
+    case MC_EV_ENTITY_REMOVE:
+      removeRemotePlayer(ev.id);
+      break;
+    case MC_EV_WINDOW_READY:
+      // A later window may already have replaced the one this event
+      // announced; it was then applied by the earlier event.
+      if ((s_sharedWindow.load(std::memory_order_acquire) & kWindowFresh) == 0) {
+        break;
+      }
+      s_takenWindow = s_sharedWindow.exchange(s_takenWindow, std::memory_order_acq_rel) & ~kWindowFresh;
+      memcpy(s_voxel, s_netWindows[s_takenWindow], sizeof(s_voxel));
+      s_worldVersion++;
+      meshInvalidateAll();
+      s_haveRemoteWorld = true;
+      break;
+  }
+}
+
+void drainEvents() {
+  McEvent ev;
+  while (s_events.pop(&ev)) {
+    applyEvent(ev);
+  }
+}
+
+// Game half: queue a command for the network half. Returns false when the
+// queue is full.
+bool postCommand(const McCommand &cmd) {
+  return s_commands.push(cmd);
+}
+
+// Game half: hand the pending control commands to the network half while
+// there is room. Never waits; whatever does not fit is retried next frame.
+void flushControlCommands() {
+  if (s_pendingHeldSlot >= 0) {
+    McCommand cmd = {};
+    cmd.type = MC_CMD_HELD_SLOT;
+    cmd.arg = static_cast<uint8_t>(s_pendingHeldSlot);
+    if (!postCommand(cmd)) {
+      return;
+    }
+    s_pendingHeldSlot = -1;
+  }
+  if (s_pendingConfig) {
+    if (!postCommand(s_pendingConfigCmd)) {
+      return;
+    }
+    s_pendingConfig = false;
+  }
+  if (s_pendingReconnect) {
+    McCommand cmd = {};
+    cmd.type = MC_CMD_RECONNECT;
+    if (!postCommand(cmd)) {
+      return;
+    }
+    s_pendingReconnect = false;
+  }
+}
+
+// Network half: hand an event to the game half without waiting. Entity
+// positions are dropped once the queue is down to its reserve; losing any
+// other event schedules a resync. Returns false when the event was dropped.
+bool postEvent(const McEvent &ev) {
+  const bool droppable = ev.type == MC_EV_ENTITY_POS;
+  if ((droppable && s_events.room() <= kEventReserve) || !s_events.push(ev)) {
+    s_eventDropCount++;
+    if (!droppable) {
+      s_eventsLost = true;
+      Serial.printf("[mc] event queue full, dropped type=%u total=%lu\n", static_cast<unsigned int>(ev.type),
+                    static_cast<unsigned long>(s_eventDropCount));
+    }
+    return false;
+  }
+  s_sessionFed = true;
+  return true;
+}
+
+bool postSimpleEvent(McEventType type) {
+  McEvent ev = {};
+  ev.type = type;
+  return postEvent(ev);
+}
+
 class PacketWriter {
  public:
   PacketWriter() : len_(0), ok_(true) {}
@@ -209,17 +469,20 @@ class PacketWriter {
   bool ok_;
 };
 
+
+// stateText must be a string literal: the game half reads it later.
 void setMcState(const char *stateText) {
-  if (s_mcState == stateText) {
+  if (strcmp(s_netStateText.load(std::memory_order_relaxed), stateText) == 0) {
     return;
   }
-  s_mcState = stateText;
+  s_netStateText.store(stateText, std::memory_order_release);
   Serial.printf("[mc] state=%s\n", stateText);
 }
 
 void setMcStage(McStage stage) {
   s_mcStage = stage;
   s_stageSinceMs = millis();
+  s_netInPlay.store(stage == MC_PLAY, std::memory_order_release);
 }
 
 void resetPacketParsing() {
@@ -231,6 +494,16 @@ void resetPacketParsing() {
   s_pktHeadLen = 0;
 }
 
+// Tells the game half to drop the session's world, anchor and players, if
+// anything was sent since the last reset.
+void resetSession() {
+  if (s_sessionFed && !postSimpleEvent(MC_EV_SESSION_RESET)) {
+    // Stays fed; the resync this schedules posts the reset again.
+    return;
+  }
+  s_sessionFed = false;
+}
+
 void closeSocketToState(const char *stateText) {
   if (s_mcSocket.connected()) {
     s_mcSocket.stop();
@@ -239,11 +512,8 @@ void closeSocketToState(const char *stateText) {
   s_sentPlayerLoaded = false;
   s_sentKnownPacksAck = false;
   s_sentConfigAck = false;
-  s_haveServerAnchor = false;
   s_haveCenterChunk = false;
-  s_haveRemoteWorld = false;
-  clearRemotePlayers();
-  clearWorld();
+  resetSession();
   resetPacketParsing();
   setMcState(stateText);
 }
@@ -321,8 +591,8 @@ bool sendHandshake() {
   PacketWriter p;
   p.writeVarInt(0x00);   // Handshake
   p.writeVarInt(772);    // bareiron protocol version
-  p.writeString(s_mcHost);
-  p.writeU16(s_mcPort);
+  p.writeString(s_netHost);
+  p.writeU16(s_netPort);
   p.writeVarInt(2);      // Next state: login
   return sendPacket(p);
 }
@@ -330,7 +600,7 @@ bool sendHandshake() {
 bool sendLoginStart() {
   PacketWriter p;
   p.writeVarInt(0x00);  // Login Start
-  String playerName = s_mcPlayerName;
+  String playerName = s_netPlayerName;
   playerName.trim();
   if (playerName.length() == 0) {
     playerName = kMcDefaultPlayer;
@@ -399,32 +669,16 @@ bool sendKeepAlive(uint64_t token) {
   return sendPacket(p);
 }
 
-bool sendMovementPacket() {
+bool sendMovementPacket(const McCommand &cmd) {
   PacketWriter p;
   p.writeVarInt(0x1E);  // Set player position and rotation
-
-  const float localFeetY = s_camY - kEyeHeight;
-  double sx = s_camX;
-  double sy = 80.0 + localFeetY;
-  double sz = s_camZ;
-  if (s_haveServerAnchor) {
-    sx = s_serverBaseX + static_cast<double>(s_camX - s_localAnchorX);
-    sy = s_serverBaseY + static_cast<double>(localFeetY - s_localAnchorFeetY);
-    sz = s_serverBaseZ + static_cast<double>(s_camZ - s_localAnchorZ);
-  }
-  s_serverFeetY = sy;
-
-  p.writeF64(sx);
-  p.writeF64(sy);
-  p.writeF64(sz);
-
-  const float kRadToDeg = 57.295779513f;
-  p.writeF32(s_yaw * kRadToDeg);
-  p.writeF32(-s_pitch * kRadToDeg);
-
-  const uint8_t onGround = isPlayerCollidingAt(s_camX, s_camY - 0.04f, s_camZ) ? 1 : 0;
-  p.writeByte(onGround);
-
+  s_serverFeetY = cmd.y;
+  p.writeF64(cmd.x);
+  p.writeF64(cmd.y);
+  p.writeF64(cmd.z);
+  p.writeF32(cmd.yaw);
+  p.writeF32(cmd.pitch);
+  p.writeByte(cmd.arg);  // on ground
   return sendPacket(p);
 }
 
@@ -452,25 +706,15 @@ uint64_t encodeBlockPos(int32_t x, int32_t y, int32_t z) {
   return (ux << 38) | (uz << 12) | uy;
 }
 
-bool sendUseItemOn(const RayHit &hit) {
+bool sendUseItemOn(const McCommand &cmd) {
   if (!s_mcSocket.connected() || s_mcStage != MC_PLAY) {
     return false;
   }
-  if (!s_haveServerAnchor) {
-    return false;
-  }
-
-  // Convert the locally targeted block to the server anchor frame.
-  const double sx = s_serverBaseX + static_cast<double>(hit.x - s_localAnchorX);
-  const double sy = s_serverBaseY + static_cast<double>(hit.y - s_localAnchorFeetY);
-  const double sz = s_serverBaseZ + static_cast<double>(hit.z - s_localAnchorZ);
-
   PacketWriter p;
   p.writeVarInt(0x3F);  // Use item on
   p.writeByte(0);       // main hand
-  p.writeU64(encodeBlockPos(static_cast<int32_t>(floor(sx)), static_cast<int32_t>(floor(sy)),
-                            static_cast<int32_t>(floor(sz))));
-  p.writeByte(faceFromNormal(hit));
+  p.writeU64(encodeBlockPos(cmd.bx, cmd.by, cmd.bz));
+  p.writeByte(cmd.arg);
   // cursor position in block (center); server ignores these values
   p.writeF32(0.5f);
   p.writeF32(0.5f);
@@ -481,29 +725,20 @@ bool sendUseItemOn(const RayHit &hit) {
   return sendPacket(p);
 }
 
-bool sendBreakBlock(const RayHit &hit) {
+bool sendBreakBlock(const McCommand &cmd) {
   if (!s_mcSocket.connected() || s_mcStage != MC_PLAY) {
     return false;
   }
-  if (!s_haveServerAnchor) {
-    return false;
-  }
-
-  // Convert targeted local voxel coordinates into server world coordinates.
-  const double sx = s_serverBaseX + static_cast<double>(hit.x - s_localAnchorX);
-  const double sy = s_serverBaseY + static_cast<double>(hit.y - s_localAnchorFeetY);
-  const double sz = s_serverBaseZ + static_cast<double>(hit.z - s_localAnchorZ);
-
   PacketWriter p;
   p.writeVarInt(0x28);  // Player action
   p.writeByte(2);       // finish mining
-  p.writeU64(encodeBlockPos(static_cast<int32_t>(floor(sx)), static_cast<int32_t>(floor(sy)),
-                            static_cast<int32_t>(floor(sz))));
-  p.writeByte(faceFromNormal(hit));
+  p.writeU64(encodeBlockPos(cmd.bx, cmd.by, cmd.bz));
+  p.writeByte(cmd.arg);
   p.writeVarInt(s_actionSequence++);
   return sendPacket(p);
 }
 
+
 bool isPlayerEntityType(int32_t entityType) {
   // bareiron currently uses 149 for players. Keep 157 for compatibility with
   // other 1.21.8 traces captured during integration.
@@ -653,15 +888,10 @@ bool decodeServerChunkIntoLocal(const uint8_t *packet, size_t len, size_t off) {
   bool worldCleared = false;
   bool wroteAny = false;
 
-  auto clearLocalChunkWindow = []() {
-    for (int x = 0; x < kWorldW; ++x) {
-      for (int y = 0; y < kWorldHMax; ++y) {
-        for (int z = 0; z < kWorldD; ++z) {
-          s_voxel[x][y][z] = BLOCK_AIR;
-        }
-      }
-    }
-  };
+  // Decode into the network half's own window; the game half still owns
+  // s_voxel and may be reading the other two.
+  auto &window = s_netWindows[s_decodeWindow];
+  auto clearLocalChunkWindow = [&window]() { memset(window, BLOCK_AIR, sizeof(window)); };
 
   // bareiron uses the vanilla 1.21 section stack with min Y = -64.
   constexpr int kSectionBaseY = -64;
@@ -707,7 +937,7 @@ bool decodeServerChunkIntoLocal(const uint8_t *packet, size_t len, size_t off) {
         }
         for (int x = 0; x < 16; ++x) {
           for (int z = 0; z < 16; ++z) {
-            s_voxel[x][ly][z] = mapped;
+            window[x][ly][z] = mapped;
           }
         }
       }
@@ -760,16 +990,33 @@ bool decodeServerChunkIntoLocal(const uint8_t *packet, size_t len, size_t off) {
           const int addr = x + (z << 4) + (dy << 8);
           const int idx = (addr & ~7) | (7 - (addr & 7));
           const uint8_t bareironBlock = sectionData[idx];
-          s_voxel[x][ly][z] = mapBareironBlockToLocal(bareironBlock);
+          window[x][ly][z] = mapBareironBlockToLocal(bareironBlock);
         }
       }
     }
     wroteAny = true;
   }
 
+  if (worldCleared) {
+    s_decodeWindow =
+        s_sharedWindow.exchange(s_decodeWindow | kWindowFresh, std::memory_order_acq_rel) & ~kWindowFresh;
+    if (!postSimpleEvent(MC_EV_WINDOW_READY)) {
+      return false;
+    }
+  }
   return wroteAny;
 }
 
+void postEntityPos(int32_t entityId, double x, double y, double z) {
+  McEvent ev = {};
+  ev.type = MC_EV_ENTITY_POS;
+  ev.id = entityId;
+  ev.x = x;
+  ev.y = y;
+  ev.z = z;
+  postEvent(ev);
+}
+
 void handlePacket(const uint8_t *packet, size_t len, size_t totalLen, bool truncated) {
   size_t off = 0;
   int32_t packetId = -1;
@@ -834,7 +1081,7 @@ void handlePacket(const uint8_t *packet, size_t len, size_t totalLen, bool trunc
     }
     setMcStage(MC_PLAY);
     setMcState("PLAY");
-    sendHeldItemSlot(static_cast<uint8_t>(s_selectedSlot));
+    sendHeldItemSlot(s_netHeldSlot);
     return;
   }
 
@@ -869,22 +1116,13 @@ void handlePacket(const uint8_t *packet, size_t len, size_t totalLen, bool trunc
         !readF32(packet, len, &off, &pitch)) {
       return;
     }
-    s_serverBaseX = x;
-    s_serverBaseY = y;
-    s_serverBaseZ = z;
     s_serverFeetY = y;
-    // Re-anchor local coordinates to keep collision and movement aligned
-    // with the streamed chunk window around the server's current position.
-    const float localFeetY = 3.0f;
-    s_camX = 7.5f;
-    s_camY = localFeetY + kEyeHeight;
-    s_camZ = 7.5f;
-    s_localAnchorX = s_camX;
-    s_localAnchorFeetY = localFeetY;
-    s_localAnchorZ = s_camZ;
-    s_haveServerAnchor = true;
-    Serial.printf("[mc] sync server=(%.2f,%.2f,%.2f) local_anchor=(%.2f,%.2f,%.2f)\n", s_serverBaseX,
-                  s_serverBaseY, s_serverBaseZ, s_localAnchorX, s_localAnchorFeetY, s_localAnchorZ);
+    McEvent ev = {};
+    ev.type = MC_EV_SYNC_POSITION;
+    ev.x = x;
+    ev.y = y;
+    ev.z = z;
+    postEvent(ev);
     return;
   }
 
@@ -917,7 +1155,7 @@ void handlePacket(const uint8_t *packet, size_t len, size_t totalLen, bool trunc
       return;
     }
     if (isPlayerEntityType(entityType)) {
-      updateRemotePlayerFromServer(entityId, x, y, z);
+      postEntityPos(entityId, x, y, z);
     }
     return;
   }
@@ -931,14 +1169,17 @@ void handlePacket(const uint8_t *packet, size_t len, size_t totalLen, bool trunc
         !readF64(packet, len, &off, &y) || !readF64(packet, len, &off, &z)) {
       return;
     }
-    updateRemotePlayerFromServer(entityId, x, y, z);
+    postEntityPos(entityId, x, y, z);
     return;
   }
 
   if (packetId == 0x46) {  // Remove entities (single)
     int32_t entityId = 0;
     if (readVarInt(packet, len, &off, &entityId)) {
-      removeRemotePlayer(entityId);
+      McEvent ev = {};
+      ev.type = MC_EV_ENTITY_REMOVE;
+      ev.id = entityId;
+      postEvent(ev);
     }
     return;
   }
@@ -949,32 +1190,11 @@ void handlePacket(const uint8_t *packet, size_t len, size_t totalLen, bool trunc
     if (!readVarInt(packet, len, &off, &cx) || !readVarInt(packet, len, &off, &cz)) {
       return;
     }
-    if (s_haveCenterChunk) {
-      const int32_t dCx = cx - s_centerChunkX;
-      const int32_t dCz = cz - s_centerChunkZ;
-      if (dCx != 0 || dCz != 0) {
-        const float shiftX = static_cast<float>(dCx * 16);
-        const float shiftZ = static_cast<float>(dCz * 16);
-        // Keep the player near the local window center while streaming chunks.
-        s_camX -= shiftX;
-        s_camZ -= shiftZ;
-        s_localAnchorX -= shiftX;
-        s_localAnchorZ -= shiftZ;
-        for (int i = 0; i < kRemotePlayerMax; ++i) {
-          if (!s_remotePlayers[i].active) {
-            continue;
-          }
-          s_remotePlayers[i].x -= shiftX;
-          s_remotePlayers[i].z -= shiftZ;
-        }
-      }
-      if (dCx != 0 || dCz != 0) {
-        Serial.printf("[mc] center (%ld,%ld)->(%ld,%ld) shift=(%ld,%ld) cam=(%.2f,%.2f)\n",
-                      static_cast<long>(s_centerChunkX), static_cast<long>(s_centerChunkZ),
-                      static_cast<long>(cx), static_cast<long>(cz), static_cast<long>(dCx * 16),
-                      static_cast<long>(dCz * 16), s_camX, s_camZ);
-      }
-    }
+    McEvent ev = {};
+    ev.type = MC_EV_CENTER_CHUNK;
+    ev.cx = cx;
+    ev.cz = cz;
+    postEvent(ev);
     s_centerChunkX = cx;
     s_centerChunkZ = cz;
     s_haveCenterChunk = true;
@@ -985,7 +1205,6 @@ void handlePacket(const uint8_t *packet, size_t len, size_t totalLen, bool trunc
     s_chunkRxCount++;
     const bool applied = decodeServerChunkIntoLocal(packet, len, off);
     if (applied) {
-      s_haveRemoteWorld = true;
       s_chunkApplyCount++;
     } else {
       s_chunkDropCount++;
@@ -1061,13 +1280,13 @@ void processIncoming() {
 }
 
 void tryConnectAndLogin() {
-  if (millis() - s_lastMcAttemptMs < kMcReconnectMs) {
+  if (millis() - s_lastAttemptMs < kMcReconnectMs) {
     return;
   }
-  s_lastMcAttemptMs = millis();
+  s_lastAttemptMs = millis();
   setMcState("CONNECTING");
 
-  if (!s_mcSocket.connect(s_mcHost.c_str(), s_mcPort)) {
+  if (!s_mcSocket.connect(s_netHost.c_str(), s_netPort)) {
     setMcState("CONNECT_FAIL");
     return;
   }
@@ -1076,10 +1295,8 @@ void tryConnectAndLogin() {
   s_sentPlayerLoaded = false;
   s_sentKnownPacksAck = false;
   s_sentConfigAck = false;
-  s_haveServerAnchor = false;
   s_haveCenterChunk = false;
-  s_haveRemoteWorld = false;
-  clearRemotePlayers();
+  resetSession();
 
   if (!sendHandshake() || !sendLoginStart()) {
     closeSocketToState("TX_FAIL");
@@ -1101,77 +1318,69 @@ bool wifiReadyForMc() {
   return static_cast<uint32_t>(WiFi.localIP()) != 0;
 }
 
-}  // namespace
-
-void mcSetConfig(const String &host, uint16_t port, const String &playerName, bool autoConnect) {
-  String trimmedHost = host;
-  trimmedHost.trim();
 
-  String trimmedPlayer = playerName;
-  trimmedPlayer.trim();
-  if (trimmedPlayer.length() == 0) {
-    trimmedPlayer = kMcDefaultPlayer;
-  }
-  if (trimmedPlayer.length() > 16) {
-    trimmedPlayer = trimmedPlayer.substring(0, 16);
-  }
-
-  if (port == 0) {
-    port = kMcDefaultPort;
-  }
-
-  const bool changed = (s_mcHost != trimmedHost) || (s_mcPort != port) || (s_mcPlayerName != trimmedPlayer) ||
-                       (s_mcAutoConnect != autoConnect);
-  s_mcHost = trimmedHost;
-  s_mcPort = port;
-  s_mcPlayerName = trimmedPlayer;
-  s_mcAutoConnect = autoConnect;
-
-  if (changed) {
-    mcForceReconnect();
+void handleCommand(const McCommand &cmd) {
+  const bool inPlay = s_mcSocket.connected() && s_mcStage == MC_PLAY;
+  switch (cmd.type) {
+    case MC_CMD_MOVE:
+      if (inPlay && !sendMovementPacket(cmd)) {
+        closeSocketToState("TX_FAIL");
+      }
+      break;
+    case MC_CMD_HELD_SLOT:
+      s_netHeldSlot = cmd.arg;
+      if (inPlay && !sendHeldItemSlot(cmd.arg)) {
+        closeSocketToState("TX_FAIL");
+      }
+      break;
+    case MC_CMD_USE_ITEM_ON:
+      sendUseItemOn(cmd);
+      break;
+    case MC_CMD_BREAK_BLOCK:
+      sendBreakBlock(cmd);
+      break;
+    case MC_CMD_CONFIG:
+      s_netHost = cmd.host;
+      s_netPort = cmd.port;
+      s_netPlayerName = cmd.name;
+      s_netAutoConnect = cmd.arg != 0;
+      break;
+    case MC_CMD_RECONNECT:
+      if (s_mcSocket.connected()) {
+        s_mcSocket.stop();
+      }
+      setMcStage(MC_IDLE);
+      s_sentPlayerLoaded = false;
+      s_sentKnownPacksAck = false;
+      s_sentConfigAck = false;
+      s_haveCenterChunk = false;
+      // Events still queued from the old session land after the game half's
+      // own reset, so follow them with another one.
+      resetSession();
+      resetPacketParsing();
+      s_lastAttemptMs = 0;
+      setMcState("RECONNECT");
+      break;
   }
 }
 
-void mcForceReconnect() {
-  if (s_mcSocket.connected()) {
-    s_mcSocket.stop();
+void drainCommands() {
+  McCommand cmd;
+  while (s_commands.pop(&cmd)) {
+    handleCommand(cmd);
   }
-  setMcStage(MC_IDLE);
-  s_sentPlayerLoaded = false;
-  s_sentKnownPacksAck = false;
-  s_sentConfigAck = false;
-  s_haveServerAnchor = false;
-  s_haveCenterChunk = false;
-  s_haveRemoteWorld = false;
-  clearRemotePlayers();
-  clearWorld();
-  resetPacketParsing();
-  s_lastMcAttemptMs = 0;
-  setMcState("RECONNECT");
 }
 
-void mcSetHeldSlot(uint8_t slot) {
-  if (slot >= 9) {
-    return;
+// One pass of the network half: apply queued commands, keep the connection
+// alive and parse whatever the socket has buffered.
+void netStep() {
+  drainCommands();
+  if (s_eventsLost) {
+    s_eventsLost = false;
+    closeSocketToState("RESYNC");
   }
-  if (s_mcSocket.connected() && s_mcStage == MC_PLAY) {
-    if (!sendHeldItemSlot(slot)) {
-      closeSocketToState("TX_FAIL");
-    }
-  }
-}
 
-bool mcTryPlaceBlockServer(const RayHit &hit, uint8_t localBlockId) {
-  (void)localBlockId;
-  return sendUseItemOn(hit);
-}
-
-bool mcTryBreakBlockServer(const RayHit &hit) {
-  return sendBreakBlock(hit);
-}
-
-void mcUpdate() {
-  unsigned long now = millis();
+  const unsigned long now = millis();
   const bool wifiReady = wifiReadyForMc();
   if (wifiReady) {
     s_lastWifiOkMs = now;
@@ -1185,12 +1394,12 @@ void mcUpdate() {
     return;
   }
 
-  if (!s_mcAutoConnect) {
+  if (!s_netAutoConnect) {
     closeSocketToState("DISABLED");
     return;
   }
 
-  if (s_mcHost.length() == 0) {
+  if (s_netHost.length() == 0) {
     closeSocketToState("NO_HOST");
     return;
   }
@@ -1208,32 +1417,164 @@ void mcUpdate() {
     closeSocketToState("DISCONNECTED");
     return;
   }
-  now = millis();
 
   if (s_mcStage != MC_IDLE && s_mcStage != MC_PLAY) {
     unsigned long idleLimit = kMcHandshakeIdleTimeoutMs;
     if (s_mcStage == MC_WAIT_CONFIG_FINISH || s_mcStage == MC_WAIT_PLAY_LOGIN) {
       idleLimit = kMcConfigIdleTimeoutMs;
     }
-    if (now - s_lastRxMs > idleLimit) {
+    if (millis() - s_lastRxMs > idleLimit) {
       closeSocketToState("RX_TIMEOUT");
-      return;
     }
   }
+}
 
-  if (s_mcStage == MC_PLAY) {
-    if (now - s_lastMoveSendMs >= kMcMovePacketMs) {
-      if (!sendMovementPacket()) {
-        closeSocketToState("TX_FAIL");
-        return;
-      }
+void mcTask(void *) {
+  while (true) {
+    netStep();
+    delay(2);
+  }
+}
+
+// Game half: report the player pose in server coordinates.
+bool postMovement() {
+  const float localFeetY = s_camY - kEyeHeight;
+  McCommand cmd = {};
+  cmd.type = MC_CMD_MOVE;
+  cmd.x = s_camX;
+  cmd.y = 80.0 + localFeetY;
+  cmd.z = s_camZ;
+  if (s_haveServerAnchor) {
+    cmd.x = s_serverBaseX + static_cast<double>(s_camX - s_localAnchorX);
+    cmd.y = s_serverBaseY + static_cast<double>(localFeetY - s_localAnchorFeetY);
+    cmd.z = s_serverBaseZ + static_cast<double>(s_camZ - s_localAnchorZ);
+  }
+  const float kRadToDeg = 57.295779513f;
+  cmd.yaw = s_yaw * kRadToDeg;
+  cmd.pitch = -s_pitch * kRadToDeg;
+  cmd.arg = isPlayerCollidingAt(s_camX, s_camY - 0.04f, s_camZ) ? 1 : 0;
+  return postCommand(cmd);
+}
+
+// Game half: convert the locally targeted block to the server anchor frame
+// and queue a block interaction for it.
+bool postBlockCommand(McCommandType type, const RayHit &hit) {
+  if (!s_netInPlay.load(std::memory_order_acquire) || !s_haveServerAnchor) {
+    return false;
+  }
+  const double sx = s_serverBaseX + static_cast<double>(hit.x - s_localAnchorX);
+  const double sy = s_serverBaseY + static_cast<double>(hit.y - s_localAnchorFeetY);
+  const double sz = s_serverBaseZ + static_cast<double>(hit.z - s_localAnchorZ);
+  McCommand cmd = {};
+  cmd.type = type;
+  cmd.bx = static_cast<int32_t>(floor(sx));
+  cmd.by = static_cast<int32_t>(floor(sy));
+  cmd.bz = static_cast<int32_t>(floor(sz));
+  cmd.arg = faceFromNormal(hit);
+  return postCommand(cmd);
+}
+
+}  // namespace
+
+void mcBegin() {
+  s_netHost = s_mcHost;
+  s_netPort = s_mcPort;
+  s_netPlayerName = s_mcPlayerName;
+  s_netAutoConnect = s_mcAutoConnect;
+  s_netHeldSlot = static_cast<uint8_t>(s_selectedSlot);
+  if (kMcClientTask && !s_taskStarted) {
+    s_taskStarted = true;
+    taskSpawn("mc", mcTask, nullptr, kMcTaskStackBytes, kMcClientCore);
+  }
+}
+
+void mcSetConfig(const String &host, uint16_t port, const String &playerName, bool autoConnect) {
+  String trimmedHost = host;
+  trimmedHost.trim();
+
+  String trimmedPlayer = playerName;
+  trimmedPlayer.trim();
+  if (trimmedPlayer.length() == 0) {
+    trimmedPlayer = kMcDefaultPlayer;
+  }
+  if (trimmedPlayer.length() > 16) {
+    trimmedPlayer = trimmedPlayer.substring(0, 16);
+  }
+
+  if (port == 0) {
+    port = kMcDefaultPort;
+  }
+
+  const bool changed = (s_mcHost != trimmedHost) || (s_mcPort != port) || (s_mcPlayerName != trimmedPlayer) ||
+                       (s_mcAutoConnect != autoConnect);
+  s_mcHost = trimmedHost;
+  s_mcPort = port;
+  s_mcPlayerName = trimmedPlayer;
+  s_mcAutoConnect = autoConnect;
+
+  if (changed) {
+    McCommand cmd = {};
+    cmd.type = MC_CMD_CONFIG;
+    strncpy(cmd.host, s_mcHost.c_str(), sizeof(cmd.host) - 1);
+    strncpy(cmd.name, s_mcPlayerName.c_str(), sizeof(cmd.name) - 1);
+    cmd.port = s_mcPort;
+    cmd.arg = s_mcAutoConnect ? 1 : 0;
+    s_pendingConfigCmd = cmd;
+    s_pendingConfig = true;
+    mcForceReconnect();
+  }
+}
+
+
+void mcForceReconnect() {
+  resetGameSession();
+  s_pendingReconnect = true;
+  flushControlCommands();
+  s_lastMoveSendMs = 0;
+}
+
+void mcSetHeldSlot(uint8_t slot) {
+  if (slot >= 9) {
+    return;
+  }
+  s_pendingHeldSlot = slot;
+  flushControlCommands();
+}
+
+bool mcTryPlaceBlockServer(const RayHit &hit, uint8_t localBlockId) {
+  (void)localBlockId;
+  return postBlockCommand(MC_CMD_USE_ITEM_ON, hit);
+}
+
+bool mcTryBreakBlockServer(const RayHit &hit) {
+  return postBlockCommand(MC_CMD_BREAK_BLOCK, hit);
+}
+
+void mcUpdate() {
+  if (!s_taskStarted) {
+    netStep();
+  }
+  drainEvents();
+  flushControlCommands();
+
+  const char *stateText = s_netStateText.load(std::memory_order_acquire);
+  if (stateText != s_shownStateText) {
+    s_shownStateText = stateText;
+    s_mcState = stateText;
+  }
+
+  const unsigned long now = millis();
+  // A move that finds the queue full is simply sent again, with the newer
+  // pose, on a later frame.
+  if (s_netInPlay.load(std::memory_order_acquire) && now - s_lastMoveSendMs >= kMcMovePacketMs) {
+    if (postMovement()) {
       s_lastMoveSendMs = now;
     }
   }
 }
 
 bool mcReadyForGameplay() {
-  return s_mcSocket.connected() && s_mcStage == MC_PLAY && s_haveRemoteWorld;
+  return s_netInPlay.load(std::memory_order_acquire) && s_haveRemoteWorld;
 }
 
 }  // namespace game
@@ -0,0 +1,305 @@
+#include "mesh_cache.h"
+
+#include "world.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace game {
+
+uint8_t s_faceMask[kWorldW][kWorldHMax][kWorldD];
+int8_t s_colFaceMinY[kWorldW][kWorldD];
+int8_t s_colFaceMaxY[kWorldW][kWorldD];
+int8_t s_colGroundTop[kWorldW][kWorldD];
+int8_t s_colSurfaceY[kWorldW][kWorldD];
+
+MeshQuad s_meshQuads[kMeshQuadCap];
+int s_meshQuadCount = 0;
+BrickMesh s_brickMesh[kBricksX][kBricksY][kBricksZ];
+int s_meshOverflowBricks = 0;
+
+namespace {
+
+constexpr int kBrickQuadMax = kBrickSize * kBrickSize * kBrickSize * 5;
+constexpr int32_t kNoFace = -1;
+
+bool s_meshAllDirty = true;
+bool s_overflowLogged = false;
+bool s_anyBrickDirty = false;
+bool s_brickDirty[kBricksX][kBricksY][kBricksZ];
+MeshQuad s_brickScratch[kBrickQuadMax];
+
+uint8_t computeFaceMask(int x, int y, int z) {
+  if (s_voxel[x][y][z] == BLOCK_AIR) {
+    return 0;
+  }
+  uint8_t mask = 0;
+  if (!isSolidVoxel(x, y + 1, z)) {
+    mask |= FACE_TOP;
+  }
+  if (!isSolidVoxel(x, y, z - 1)) {
+    mask |= FACE_NORTH;
+  }
+  if (!isSolidVoxel(x, y, z + 1)) {
+    mask |= FACE_SOUTH;
+  }
+  if (!isSolidVoxel(x - 1, y, z)) {
+    mask |= FACE_WEST;
+  }
+  if (!isSolidVoxel(x + 1, y, z)) {
+    mask |= FACE_EAST;
+  }
+  return mask;
+}
+
+void refreshColumnRange(int x, int z) {
+  int8_t minY = -1;
+  int8_t maxY = -1;
+  for (int y = 0; y < kWorldHMax; ++y) {
+    if (s_faceMask[x][y][z] == 0) {
+      continue;
+    }
+    if (minY < 0) {
+      minY = static_cast<int8_t>(y);
+    }
+    maxY = static_cast<int8_t>(y);
+  }
+  s_colFaceMinY[x][z] = minY;
+  s_colFaceMaxY[x][z] = maxY;
+
+  int8_t groundTop = -1;
+  while (groundTop + 1 < kWorldHMax && s_voxel[x][groundTop + 1][z] != BLOCK_AIR) {
+    groundTop++;
+  }
+  s_colGroundTop[x][z] = groundTop;
+
+  int8_t surfaceY = kWorldHMax - 1;
+  while (surfaceY >= 0 && s_voxel[x][surfaceY][z] == BLOCK_AIR) {
+    surfaceY--;
+  }
+  s_colSurfaceY[x][z] = surfaceY;
+}
+
+void refreshVoxel(int x, int y, int z) {
+  if (!inWorldXYZ(x, y, z)) {
+    return;
+  }
+  const uint8_t mask = computeFaceMask(x, y, z);
+  if (mask == s_faceMask[x][y][z]) {
+    return;
+  }
+  s_faceMask[x][y][z] = mask;
+  s_brickDirty[x / kBrickSize][y / kBrickSize][z / kBrickSize] = true;
+  s_anyBrickDirty = true;
+}
+
+// Voxel coordinates of cell (u, v) on slice `w` of a brick for face `dir`.
+void sliceToVoxel(uint8_t dir, int bx, int by, int bz, int w, int u, int v, int *x, int *y, int *z) {
+  if (dir == FACE_TOP) {
+    *x = bx + u;
+    *y = by + w;
+    *z = bz + v;
+  } else if (dir == FACE_NORTH || dir == FACE_SOUTH) {
+    *x = bx + u;
+    *y = by + v;
+    *z = bz + w;
+  } else {
+    *x = bx + w;
+    *y = by + v;
+    *z = bz + u;
+  }
+}
+
+int meshBrick(int bx, int by, int bz, MeshQuad *out) {
+  static constexpr uint8_t kDirs[] = {FACE_TOP, FACE_NORTH, FACE_SOUTH, FACE_WEST, FACE_EAST};
+  const int x0 = bx * kBrickSize;
+  const int y0 = by * kBrickSize;
+  const int z0 = bz * kBrickSize;
+  const int yCount = std::min(kBrickSize, kWorldHMax - y0);
+  int count = 0;
+
+  for (uint8_t dir : kDirs) {
+    // Slices run along the face normal; (u, v) span the face plane.
+    const int wCount = (dir == FACE_TOP) ? yCount : kBrickSize;
+    const int vCount = (dir == FACE_TOP) ? kBrickSize : yCount;
+    for (int w = 0; w < wCount; ++w) {
+      int32_t key[kBrickSize][kBrickSize];
+      for (int v = 0; v < vCount; ++v) {
+        for (int u = 0; u < kBrickSize; ++u) {
+          int x = 0;
+          int y = 0;
+          int z = 0;
+          sliceToVoxel(dir, x0, y0, z0, w, u, v, &x, &y, &z);
+          if ((s_faceMask[x][y][z] & dir) == 0) {
+            key[v][u] = kNoFace;
+            continue;
+          }
+          const uint8_t blockId = s_voxel[x][y][z];
+          key[v][u] = (dir == FACE_TOP) ? blockTopColor(blockId) : blockSideColor(blockId);
+        }
+      }
+
+      for (int v = 0; v < vCount; ++v) {
+        for (int u = 0; u < kBrickSize; ++u) {
+          const int32_t k = key[v][u];
+          if (k == kNoFace) {
+            continue;
+          }
+          int du = 1;
+          while (u + du < kBrickSize && key[v][u + du] == k) {
+            du++;
+          }
+          int dv = 1;
+          while (v + dv < vCount) {
+            bool rowMatches = true;
+            for (int i = 0; i < du; ++i) {
+              if (key[v + dv][u + i] != k) {
+                rowMatches = false;
+                break;
+              }
+            }
+            if (!rowMatches) {
+              break;
+            }
+            dv++;
+          }
+          for (int j = 0; j < dv; ++j) {
+            for (int i = 0; i < du; ++i) {
+              key[v + j][u + i] = kNoFace;
+            }
+          }
+
+          int x = 0;
+          int y = 0;
+          int z = 0;
+          sliceToVoxel(dir, x0, y0, z0, w, u, v, &x, &y, &z);
+          MeshQuad &q = out[count++];
+          q.x = static_cast<uint8_t>(x);
+          q.y = static_cast<uint8_t>(y);
+          q.z = static_cast<uint8_t>(z);
+          q.dir = dir;
+          q.du = static_cast<uint8_t>(du);
+          q.dv = static_cast<uint8_t>(dv);
+          q.color = static_cast<uint16_t>(k);
+        }
+      }
+    }
+  }
+  return count;
+}
+
+// Replace one brick's slice of the quad pool, shifting the bricks after it.
+// A brick that does not fit gives up its slice and is drawn as unit faces.
+void rebuildBrick(int bx, int by, int bz) {
+  BrickMesh &mesh = s_brickMesh[bx][by][bz];
+  int newCount = meshBrick(bx, by, bz, s_brickScratch);
+  const int oldEnd = mesh.first + mesh.count;
+  const int room = kMeshQuadCap - (s_meshQuadCount - mesh.count);
+  const bool overflow = newCount > room;
+  if (overflow) {
+    newCount = 0;
+    if (!s_overflowLogged) {
+      s_overflowLogged = true;
+      Serial.printf("[mesh] quad pool full (%d), brick (%d,%d,%d) falls back to unit faces\n", kMeshQuadCap, bx,
+                    by, bz);
+    }
+  }
+  if (overflow != mesh.unitFaces) {
+    s_meshOverflowBricks += overflow ? 1 : -1;
+    mesh.unitFaces = overflow;
+  }
+  const int delta = newCount - mesh.count;
+  if (delta != 0) {
+    memmove(&s_meshQuads[oldEnd + delta], &s_meshQuads[oldEnd],
+            static_cast<size_t>(s_meshQuadCount - oldEnd) * sizeof(MeshQuad));
+    s_meshQuadCount += delta;
+    BrickMesh *bricks = &s_brickMesh[0][0][0];
+    const int self = static_cast<int>(&mesh - bricks);
+    for (int i = self + 1; i < kBricksX * kBricksY * kBricksZ; ++i) {
+      bricks[i].first = static_cast<uint16_t>(bricks[i].first + delta);
+    }
+  }
+  memcpy(&s_meshQuads[mesh.first], s_brickScratch, static_cast<size_t>(newCount) * sizeof(MeshQuad));
+  mesh.count = static_cast<uint16_t>(newCount);
+}
+
+}  // namespace
+
+void meshInvalidateAll() {
+  s_meshAllDirty = true;
+}
+
+void meshVoxelChanged(int x, int y, int z) {
+  if (s_meshAllDirty) {
+    return;
+  }
+  // A voxel only affects its own faces and the faces of its six neighbours.
+  refreshVoxel(x, y, z);
+  refreshVoxel(x, y + 1, z);
+  refreshVoxel(x, y - 1, z);
+  refreshVoxel(x, y, z - 1);
+  refreshVoxel(x, y, z + 1);
+  refreshVoxel(x - 1, y, z);
+  refreshVoxel(x + 1, y, z);
+  // The block type may change colour without changing any face mask.
+  s_brickDirty[x / kBrickSize][y / kBrickSize][z / kBrickSize] = true;
+  s_anyBrickDirty = true;
+
+  refreshColumnRange(x, z);
+  if (z > 0) {
+    refreshColumnRange(x, z - 1);
+  }
+  if (z + 1 < kWorldD) {
+    refreshColumnRange(x, z + 1);
+  }
+  if (x > 0) {
+    refreshColumnRange(x - 1, z);
+  }
+  if (x + 1 < kWorldW) {
+    refreshColumnRange(x + 1, z);
+  }
+}
+
+void meshUpdate() {
+  if (s_meshAllDirty) {
+    s_meshAllDirty = false;
+    for (int x = 0; x < kWorldW; ++x) {
+      for (int z = 0; z < kWorldD; ++z) {
+        for (int y = 0; y < kWorldHMax; ++y) {
+          s_faceMask[x][y][z] = computeFaceMask(x, y, z);
+        }
+        refreshColumnRange(x, z);
+      }
+    }
+    s_meshQuadCount = 0;
+    s_meshOverflowBricks = 0;
+    for (int bx = 0; bx < kBricksX; ++bx) {
+      for (int by = 0; by < kBricksY; ++by) {
+        for (int bz = 0; bz < kBricksZ; ++bz) {
+          s_brickMesh[bx][by][bz] = {static_cast<uint16_t>(s_meshQuadCount), 0, false};
+          rebuildBrick(bx, by, bz);
+          s_brickDirty[bx][by][bz] = false;
+        }
+      }
+    }
+    s_anyBrickDirty = false;
+    return;
+  }
+
+  if (!s_anyBrickDirty) {
+    return;
+  }
+  s_anyBrickDirty = false;
+  for (int bx = 0; bx < kBricksX; ++bx) {
+    for (int by = 0; by < kBricksY; ++by) {
+      for (int bz = 0; bz < kBricksZ; ++bz) {
+        if (s_brickDirty[bx][by][bz]) {
+          s_brickDirty[bx][by][bz] = false;
+          rebuildBrick(bx, by, bz);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace game
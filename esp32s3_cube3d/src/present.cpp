@@ -0,0 +1,160 @@
+#include "present.h"
+
+#include "task_port.h"
+
+#include <atomic>
+
+namespace game {
+
+namespace {
+
+class TftSink : public DisplaySink {
+ public:
+  void pushRect(int x, int y, int w, int h, const Pixel *pixels, int stride) override {
+    tft.startWrite();
+    tft.setAddrWindow(x, y, w, h);
+    for (int row = 0; row < h; ++row) {
+      const Pixel *src = pixels + row * stride;
+      if constexpr (kIndexedFramebuffer) {
+        // Expand one line through the palette; writePixels blocks until
+        // the line is sent, so the buffer can be reused for the next.
+        for (int i = 0; i < w; ++i) {
+          line_[i] = s_palette[src[i]];
+        }
+        tft.writePixels(line_, w);
+      } else {
+        tft.writePixels(const_cast<uint16_t *>(reinterpret_cast<const uint16_t *>(src)), w);
+      }
+    }
+    tft.endWrite();
+  }
+
+ private:
+  uint16_t line_[kScreenW];
+};
+
+TftSink s_tftSink;
+DisplaySink *s_sink = &s_tftSink;
+
+// Second frame buffer; the first one is the canvas' own allocation.
+alignas(4) Pixel s_altBuffer[kAsyncPresent ? kScreenW * kScreenH : 1];
+Pixel *s_spareBuffer = s_altBuffer;
+
+bool s_asyncStarted = false;
+const Pixel *s_pendingFrame = nullptr;
+TaskSignal s_frameReady;
+TaskSignal s_frameDone;
+
+uint32_t s_tileHash[kPresentTilesY][kPresentTilesX];
+// Only touched by whoever runs presentFrame(); other threads ask for a
+// full resend through s_invalidateRequest, which the next frame consumes.
+bool s_tileHashValid = false;
+std::atomic<bool> s_invalidateRequest{true};
+
+uint32_t hashTile(const Pixel *fb, int tx, int ty) {
+  // FNV-1a over 32-bit words; a tile row is kTileRowWords words.
+  constexpr int kTileRowWords = kPresentTile * static_cast<int>(sizeof(Pixel)) / 4;
+  uint32_t h = 2166136261u;
+  const Pixel *row = fb + ty * kPresentTile * kScreenW + tx * kPresentTile;
+  for (int y = 0; y < kPresentTile; ++y) {
+    const uint32_t *w = reinterpret_cast<const uint32_t *>(row);
+    for (int i = 0; i < kTileRowWords; ++i) {
+      h = (h ^ w[i]) * 16777619u;
+    }
+    row += kScreenW;
+  }
+  return h;
+}
+
+void presentTask(void *) {
+  for (;;) {
+    s_frameReady.take();
+    presentFrame(s_pendingFrame);
+    s_frameDone.give();
+  }
+}
+
+}  // namespace
+
+void presentBegin() {
+  if (!kAsyncPresent || s_asyncStarted) {
+    return;
+  }
+  s_frameReady.begin(false);
+  s_frameDone.begin(true);
+  s_asyncStarted = true;
+  taskSpawn("present", presentTask, nullptr, 4096, kPresentCore);
+}
+
+void presentSetSink(DisplaySink *sink) {
+  presentWait();
+  s_sink = (sink != nullptr) ? sink : &s_tftSink;
+  presentInvalidate();
+}
+
+void presentInvalidate() {
+  s_invalidateRequest.store(true, std::memory_order_release);
+}
+
+void presentFrame(const Pixel *fb) {
+  const unsigned long startUs = micros();
+  uint32_t bytes = 0;
+  if (s_invalidateRequest.exchange(false, std::memory_order_acq_rel)) {
+    s_tileHashValid = false;
+  }
+  if (!kDirtyTilePresent) {
+    s_sink->pushRect(0, 0, kScreenW, kScreenH, fb, kScreenW);
+    bytes = kScreenW * kScreenH * 2;
+  } else {
+    for (int ty = 0; ty < kPresentTilesY; ++ty) {
+      // Runs of adjacent dirty tiles in a tile row share one address window.
+      int runStart = -1;
+      for (int tx = 0; tx <= kPresentTilesX; ++tx) {
+        bool dirty = false;
+        if (tx < kPresentTilesX) {
+          const uint32_t h = hashTile(fb, tx, ty);
+          dirty = !s_tileHashValid || h != s_tileHash[ty][tx];
+          s_tileHash[ty][tx] = h;
+        }
+        if (dirty && runStart < 0) {
+          runStart = tx;
+        } else if (!dirty && runStart >= 0) {
+          const int x = runStart * kPresentTile;
+          const int y = ty * kPresentTile;
+          const int w = (tx - runStart) * kPresentTile;
+          s_sink->pushRect(x, y, w, kPresentTile, fb + y * kScreenW + x, kScreenW);
+          bytes += static_cast<uint32_t>(w * kPresentTile * 2);
+          runStart = -1;
+        }
+      }
+    }
+    s_tileHashValid = true;
+  }
+  s_statPresentBytes.fetch_add(bytes, std::memory_order_relaxed);
+  s_statPresentUs.fetch_add(static_cast<uint32_t>(micros() - startUs), std::memory_order_relaxed);
+}
+
+void presentSwap() {
+  Pixel *finished = canvas.getBuffer();
+  if (!s_asyncStarted) {
+    presentFrame(finished);
+    return;
+  }
+  const unsigned long waitStartUs = micros();
+  s_frameDone.take();
+  s_statPresentWaitUs += micros() - waitStartUs;
+  s_pendingFrame = finished;
+  s_frameReady.give();
+  canvas.setBuffer(s_spareBuffer);
+  s_spareBuffer = finished;
+}
+
+void presentWait() {
+  if (!s_asyncStarted) {
+    return;
+  }
+  s_frameDone.take();
+  s_frameDone.give();
+}
+
+}  // namespace game
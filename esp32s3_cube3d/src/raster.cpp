@@ -0,0 +1,514 @@
+#include "raster.h"
+
+#include "task_port.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace game {
+
+namespace {
+
+// Covered x-range [start, end) of one scanline.
+struct CoverSpan {
+  uint8_t start;
+  uint8_t end;
+};
+
+constexpr int kCoverSpanCap = 24;
+
+int16_t s_rowLeft[kScreenH];
+int16_t s_rowRight[kScreenH];
+int32_t s_rowLeftW[kScreenH];
+int32_t s_rowRightW[kScreenH];
+
+// Only allocated when the depth-buffer raster mode is compiled in.
+uint16_t s_depth[kRasterMode == RASTER_ZBUFFER ? kScreenW * kScreenH : 1];
+
+// Tiled mode: face references binned per screen tile, stored back to back
+// (tile t owns s_binRefs[s_binStart[t] .. s_binStart[t + 1])).
+constexpr int kBinTileW = 32;
+constexpr int kBinTileH = 32;
+constexpr int kBinCols = kScreenW / kBinTileW;
+constexpr int kBinRows = kScreenH / kBinTileH;
+constexpr int kBinRefCap = kRasterMode == RASTER_TILED ? kMaxFaces * 3 : 1;
+
+uint16_t s_binStart[kBinCols * kBinRows + 1];
+uint16_t s_binFill[kBinCols * kBinRows];
+uint16_t s_binRefs[kBinRefCap];
+
+// One scratch tile per raster worker: the render loop is worker 0.
+constexpr int kTileWorkers = kParallelRaster ? 2 : 1;
+alignas(4) Pixel s_tilePixels[kTileWorkers][kRasterMode == RASTER_TILED ? kBinTileW * kBinTileH : 1];
+
+// Tile rows cover disjoint scanlines, so workers that claim whole rows can
+// share s_rowLeft / s_rowRight without stepping on each other.
+std::atomic<int> s_nextTileRow{0};
+// One precomputed row each of sky and ground fog; cleared rows are copied
+// from them. Built before the helper starts so it never touches the palette.
+alignas(4) Pixel s_skyRow[kScreenW];
+alignas(4) Pixel s_fogRow[kScreenW];
+bool s_backgroundReady = false;
+
+void buildBackgroundRows() {
+  if (s_backgroundReady) {
+    return;
+  }
+  fillRow(s_skyRow, 0, kScreenW, toPixel(kSky));
+  fillRow(s_fogRow, 0, kScreenW, toPixel(kGroundFog));
+  s_backgroundReady = true;
+}
+
+const Pixel *backgroundRow(int y) {
+  return (y < s_viewH / 2) ? s_skyRow : s_fogRow;
+}
+int s_tileCols = 0;
+int s_tileRows = 0;
+
+bool s_helperStarted = false;
+TaskSignal s_helperStart;
+TaskSignal s_helperDone;
+
+CoverSpan s_cover[kScreenH][kCoverSpanCap];
+uint8_t s_coverCount[kScreenH];
+bool s_rowFull[kScreenH];
+int s_fullRows = 0;
+
+// 16-bit depth key: kNearPlane / z scaled to 0..65535, larger is nearer.
+// 1/z is affine in screen space, so it can be interpolated linearly.
+int32_t depthKey(float cz) {
+  const float w = (kNearPlane / cz) * 65535.0f;
+  return static_cast<int32_t>(std::max(0.0f, std::min(65535.0f, w)));
+}
+
+// Walks the four edges of a projected face once and records, per scanline
+// in [clipY0, clipY1], the leftmost and rightmost crossing (plus the 1/z
+// there, in 8-bit sub-units, when kDepth is set). Returns false when the
+// face misses those rows.
+template <bool kDepth>
+bool scanFaceRows(const FaceQuad &f, int clipY0, int clipY1, int *outY0, int *outY1) {
+  int yMin = f.p[0].sy;
+  int yMax = f.p[0].sy;
+  for (int i = 1; i < 4; ++i) {
+    yMin = std::min<int>(yMin, f.p[i].sy);
+    yMax = std::max<int>(yMax, f.p[i].sy);
+  }
+  const int y0 = std::max(clipY0, yMin);
+  const int y1 = std::min(clipY1, yMax);
+  if (y0 > y1) {
+    return false;
+  }
+  for (int y = y0; y <= y1; ++y) {
+    s_rowLeft[y] = INT16_MAX;
+    s_rowRight[y] = INT16_MIN;
+  }
+
+  int32_t w[4] = {0, 0, 0, 0};
+  if (kDepth) {
+    for (int i = 0; i < 4; ++i) {
+      w[i] = depthKey(f.p[i].cz) << 8;
+    }
+  }
+
+  for (int i = 0; i < 4; ++i) {
+    const int ia = i;
+    const int ib = (i + 1) & 3;
+    const int it = (f.p[ia].sy <= f.p[ib].sy) ? ia : ib;
+    const int ibm = (it == ia) ? ib : ia;
+    const ProjVert &top = f.p[it];
+    const ProjVert &bottom = f.p[ibm];
+    const int ey0 = std::max<int>(y0, top.sy);
+    const int ey1 = std::min<int>(y1, bottom.sy);
+    if (ey0 > ey1) {
+      continue;
+    }
+    const int dy = bottom.sy - top.sy;
+    if (dy == 0) {
+      const int il = (top.sx <= bottom.sx) ? it : ibm;
+      const int ir = (il == it) ? ibm : it;
+      if (f.p[il].sx < s_rowLeft[ey0]) {
+        s_rowLeft[ey0] = f.p[il].sx;
+        s_rowLeftW[ey0] = w[il];
+      }
+      if (f.p[ir].sx > s_rowRight[ey0]) {
+        s_rowRight[ey0] = f.p[ir].sx;
+        s_rowRightW[ey0] = w[ir];
+      }
+      continue;
+    }
+    // 16.16 fixed-point x stepped one scanline at a time.
+    const int32_t slope = (static_cast<int32_t>(bottom.sx - top.sx) << 16) / dy;
+    int32_t x = (static_cast<int32_t>(top.sx) << 16) + slope * (ey0 - top.sy) + 0x8000;
+    const int32_t wSlope = kDepth ? (w[ibm] - w[it]) / dy : 0;
+    int32_t wy = kDepth ? w[it] + wSlope * (ey0 - top.sy) : 0;
+    for (int y = ey0; y <= ey1; ++y) {
+      const int16_t xi = static_cast<int16_t>(x >> 16);
+      if (xi < s_rowLeft[y]) {
+        s_rowLeft[y] = xi;
+        if (kDepth) {
+          s_rowLeftW[y] = wy;
+        }
+      }
+      if (xi > s_rowRight[y]) {
+        s_rowRight[y] = xi;
+        if (kDepth) {
+          s_rowRightW[y] = wy;
+        }
+      }
+      x += slope;
+      wy += wSlope;
+    }
+  }
+  *outY0 = y0;
+  *outY1 = y1;
+  return true;
+}
+
+// Writes the uncovered parts of [a, b) on scanline y and merges the span
+// into the row's coverage list.
+void coverSpan(Pixel *fb, int y, int a, int b, Pixel color) {
+  CoverSpan *list = s_cover[y];
+  int n = s_coverCount[y];
+  Pixel *row = fb + y * kScreenW;
+
+  int i = 0;
+  while (i < n && list[i].end < a) {
+    i++;
+  }
+  int cur = a;
+  int newStart = a;
+  int newEnd = b;
+  int j = i;
+  while (j < n && list[j].start <= b) {
+    if (list[j].start > cur) {
+      fillRow(row, cur, std::min<int>(list[j].start, b), color);
+    }
+    cur = std::max<int>(cur, list[j].end);
+    newStart = std::min<int>(newStart, list[j].start);
+    newEnd = std::max<int>(newEnd, list[j].end);
+    j++;
+  }
+  if (cur < b) {
+    fillRow(row, cur, b, color);
+  }
+
+  const int merged = j - i;
+  if (merged == 0) {
+    if (n == kCoverSpanCap) {
+      // List is full: bridge to the nearest neighbour. The bridged gap gets
+      // this face's colour, which only happens on pathological rows.
+      const int k = (i < n) ? i : i - 1;
+      if (list[k].start > b) {
+        fillRow(row, b, list[k].start, color);
+        list[k].start = static_cast<uint8_t>(a);
+      } else {
+        fillRow(row, list[k].end, a, color);
+        list[k].end = static_cast<uint8_t>(b);
+      }
+    } else {
+      for (int k = n; k > i; --k) {
+        list[k] = list[k - 1];
+      }
+      list[i] = {static_cast<uint8_t>(a), static_cast<uint8_t>(b)};
+      n++;
+    }
+  } else {
+    list[i] = {static_cast<uint8_t>(newStart), static_cast<uint8_t>(newEnd)};
+    for (int k = j; k < n; ++k) {
+      list[k - merged + 1] = list[k];
+    }
+    n -= merged - 1;
+  }
+  s_coverCount[y] = static_cast<uint8_t>(n);
+
+  if (!s_rowFull[y] && n == 1 && list[0].start == 0 && list[0].end == s_viewW) {
+    s_rowFull[y] = true;
+    s_fullRows++;
+  }
+}
+
+// Inclusive range of tiles a face's screen bounds touch in a cols x rows
+// grid. Returns false when the face lies outside the view.
+bool faceTileRange(const FaceQuad &f, int cols, int rows, int *tx0, int *ty0, int *tx1, int *ty1) {
+  int xMin = f.p[0].sx;
+  int xMax = f.p[0].sx;
+  int yMin = f.p[0].sy;
+  int yMax = f.p[0].sy;
+  for (int i = 1; i < 4; ++i) {
+    xMin = std::min<int>(xMin, f.p[i].sx);
+    xMax = std::max<int>(xMax, f.p[i].sx);
+    yMin = std::min<int>(yMin, f.p[i].sy);
+    yMax = std::max<int>(yMax, f.p[i].sy);
+  }
+  if (xMax < 0 || yMax < 0 || xMin >= s_viewW || yMin >= s_viewH) {
+    return false;
+  }
+  *tx0 = std::max(0, xMin) / kBinTileW;
+  *ty0 = std::max(0, yMin) / kBinTileH;
+  *tx1 = std::min(cols - 1, xMax / kBinTileW);
+  *ty1 = std::min(rows - 1, yMax / kBinTileH);
+  return true;
+}
+
+// Draws one tile's faces in painter order into a worker's scratch tile,
+// then copies the tile to the canvas row by row.
+void rasterTile(Pixel *fb, Pixel *scratch, int tile, int x0, int y0, int w, int h) {
+  for (int r = 0; r < h; ++r) {
+    memcpy(scratch + r * kBinTileW, backgroundRow(y0 + r), static_cast<size_t>(w) * sizeof(Pixel));
+  }
+  const int x1 = x0 + w - 1;
+  for (int k = s_binStart[tile]; k < s_binStart[tile + 1]; ++k) {
+    const FaceQuad &f = s_faces[s_binRefs[k]];
+    int fy0 = 0;
+    int fy1 = 0;
+    if (!scanFaceRows<false>(f, y0, y0 + h - 1, &fy0, &fy1)) {
+      continue;
+    }
+    for (int y = fy0; y <= fy1; ++y) {
+      const int a = std::max<int>(x0, s_rowLeft[y]);
+      const int b = std::min<int>(x1, s_rowRight[y]) + 1;
+      if (a < b) {
+        fillRow(scratch + (y - y0) * kBinTileW, a - x0, b - x0, f.color);
+      }
+    }
+  }
+  for (int r = 0; r < h; ++r) {
+    memcpy(fb + (y0 + r) * kScreenW + x0, scratch + r * kBinTileW, static_cast<size_t>(w) * sizeof(Pixel));
+  }
+}
+
+void rasterTileRows(int worker) {
+  Pixel *fb = canvas.getBuffer();
+  for (;;) {
+    const int ty = s_nextTileRow.fetch_add(1);
+    if (ty >= s_tileRows) {
+      return;
+    }
+    const int y0 = ty * kBinTileH;
+    const int h = std::min(kBinTileH, s_viewH - y0);
+    for (int tx = 0; tx < s_tileCols; ++tx) {
+      const int x0 = tx * kBinTileW;
+      rasterTile(fb, s_tilePixels[worker], ty * s_tileCols + tx, x0, y0, std::min(kBinTileW, s_viewW - x0), h);
+    }
+  }
+}
+
+void rasterHelperTask(void *) {
+  for (;;) {
+    s_helperStart.take();
+    rasterTileRows(1);
+    s_helperDone.give();
+  }
+}
+
+}  // namespace
+
+void rasterBegin() {
+  if (!kParallelRaster || kRasterMode != RASTER_TILED || s_helperStarted) {
+    return;
+  }
+  s_helperStart.begin(false);
+  s_helperDone.begin(false);
+  s_helperStarted = true;
+  taskSpawn("raster", rasterHelperTask, nullptr, 4096, kRasterHelperCore, kRasterHelperPriority);
+}
+
+void rasterFacesFrontToBack() {
+  Pixel *fb = canvas.getBuffer();
+  for (int y = 0; y < s_viewH; ++y) {
+    s_coverCount[y] = 0;
+    s_rowFull[y] = false;
+  }
+  s_fullRows = 0;
+
+  // s_faceOrder runs far-to-near, so walk it backwards.
+  for (int i = s_faceCount - 1; i >= 0 && s_fullRows < s_viewH; --i) {
+    const FaceQuad &f = s_faces[s_faceOrder[i]];
+    int y0 = 0;
+    int y1 = 0;
+    if (!scanFaceRows<false>(f, 0, s_viewH - 1, &y0, &y1)) {
+      continue;
+    }
+    for (int y = y0; y <= y1; ++y) {
+      if (s_rowFull[y]) {
+        continue;
+      }
+      const int a = std::max<int>(0, s_rowLeft[y]);
+      const int b = std::min<int>(s_viewW - 1, s_rowRight[y]) + 1;
+      if (a < b) {
+        coverSpan(fb, y, a, b, f.color);
+      }
+    }
+  }
+
+  // Whatever is still uncovered gets the sky / ground-fog backdrop.
+  for (int y = 0; y < s_viewH; ++y) {
+    if (s_rowFull[y]) {
+      continue;
+    }
+    const Pixel bg = toPixel((y < s_viewH / 2) ? kSky : kGroundFog);
+    Pixel *row = fb + y * kScreenW;
+    int x = 0;
+    for (int k = 0; k < s_coverCount[y]; ++k) {
+      fillRow(row, x, s_cover[y][k].start, bg);
+      x = s_cover[y][k].end;
+    }
+    fillRow(row, x, s_viewW, bg);
+  }
+}
+
+void rasterClearView() {
+  buildBackgroundRows();
+  Pixel *fb = canvas.getBuffer();
+  for (int y = 0; y < s_viewH; ++y) {
+    memcpy(fb + y * kScreenW, backgroundRow(y), static_cast<size_t>(s_viewW) * sizeof(Pixel));
+  }
+}
+
+void rasterFacesDepthTested() {
+  Pixel *fb = canvas.getBuffer();
+  rasterClearView();
+  std::fill(s_depth, s_depth + sizeof(s_depth) / sizeof(s_depth[0]), 0);
+  if (kRasterMode != RASTER_ZBUFFER) {
+    return;
+  }
+
+  for (int i = 0; i < s_faceCount; ++i) {
+    const FaceQuad &f = s_faces[i];
+    int y0 = 0;
+    int y1 = 0;
+    if (!scanFaceRows<true>(f, 0, s_viewH - 1, &y0, &y1)) {
+      continue;
+    }
+    for (int y = y0; y <= y1; ++y) {
+      const int left = s_rowLeft[y];
+      const int right = s_rowRight[y];
+      const int a = std::max(0, left);
+      const int b = std::min(s_viewW - 1, right);
+      if (a > b) {
+        continue;
+      }
+      const int32_t dw = (right > left) ? (s_rowRightW[y] - s_rowLeftW[y]) / (right - left) : 0;
+      int32_t w = s_rowLeftW[y] + dw * (a - left);
+      Pixel *row = fb + y * kScreenW;
+      uint16_t *depthRow = s_depth + y * kScreenW;
+      for (int x = a; x <= b; ++x) {
+        const uint16_t z = static_cast<uint16_t>(w >> 8);
+        if (z > depthRow[x]) {
+          depthRow[x] = z;
+          row[x] = f.color;
+        }
+        w += dw;
+      }
+    }
+  }
+}
+
+void rasterFillQuad(const FaceQuad &f) {
+  int y0 = 0;
+  int y1 = 0;
+  if (!scanFaceRows<false>(f, 0, s_viewH - 1, &y0, &y1)) {
+    return;
+  }
+  Pixel *row = canvas.getBuffer() + y0 * kScreenW;
+  for (int y = y0; y <= y1; ++y, row += kScreenW) {
+    const int a = std::max<int>(0, s_rowLeft[y]);
+    const int b = std::min<int>(s_viewW - 1, s_rowRight[y]) + 1;
+    fillRow(row, a, b, f.color);
+  }
+}
+
+void rasterDepthRect(int x0, int y0, int x1, int y1, float cz, uint16_t color) {
+  if (kRasterMode != RASTER_ZBUFFER) {
+    return;
+  }
+  x0 = std::max(0, x0);
+  y0 = std::max(0, y0);
+  x1 = std::min(s_viewW - 1, x1);
+  y1 = std::min(s_viewH - 1, y1);
+  const uint16_t z = static_cast<uint16_t>(depthKey(cz));
+  const Pixel px = toPixel(color);
+  Pixel *fb = canvas.getBuffer();
+  for (int y = y0; y <= y1; ++y) {
+    Pixel *row = fb + y * kScreenW;
+    uint16_t *depthRow = s_depth + y * kScreenW;
+    for (int x = x0; x <= x1; ++x) {
+      if (z > depthRow[x]) {
+        depthRow[x] = z;
+        row[x] = px;
+      }
+    }
+  }
+}
+
+void rasterFacesTiled() {
+  if (kRasterMode != RASTER_TILED) {
+    return;
+  }
+  const int cols = (s_viewW + kBinTileW - 1) / kBinTileW;
+  const int rows = (s_viewH + kBinTileH - 1) / kBinTileH;
+  const int tiles = cols * rows;
+
+  // Count, then place, each face's references so every bin keeps the
+  // far-to-near order of s_faceOrder.
+  std::fill(s_binFill, s_binFill + tiles, 0);
+  int total = 0;
+  for (int i = 0; i < s_faceCount; ++i) {
+    int tx0 = 0;
+    int ty0 = 0;
+    int tx1 = 0;
+    int ty1 = 0;
+    if (!faceTileRange(s_faces[s_faceOrder[i]], cols, rows, &tx0, &ty0, &tx1, &ty1)) {
+      continue;
+    }
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      for (int tx = tx0; tx <= tx1; ++tx) {
+        s_binFill[ty * cols + tx]++;
+      }
+    }
+    total += (tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+  }
+  if (total > kBinRefCap) {
+    // Too many large faces to bin this frame: draw them straight through.
+    rasterClearView();
+    for (int i = 0; i < s_faceCount; ++i) {
+      rasterFillQuad(s_faces[s_faceOrder[i]]);
+    }
+    return;
+  }
+  s_binStart[0] = 0;
+  for (int t = 0; t < tiles; ++t) {
+    s_binStart[t + 1] = static_cast<uint16_t>(s_binStart[t] + s_binFill[t]);
+    s_binFill[t] = s_binStart[t];
+  }
+  for (int i = 0; i < s_faceCount; ++i) {
+    int tx0 = 0;
+    int ty0 = 0;
+    int tx1 = 0;
+    int ty1 = 0;
+    if (!faceTileRange(s_faces[s_faceOrder[i]], cols, rows, &tx0, &ty0, &tx1, &ty1)) {
+      continue;
+    }
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      for (int tx = tx0; tx <= tx1; ++tx) {
+        s_binRefs[s_binFill[ty * cols + tx]++] = s_faceOrder[i];
+      }
+    }
+  }
+
+  s_tileCols = cols;
+  s_tileRows = rows;
+  buildBackgroundRows();
+  s_nextTileRow.store(0);
+  if (s_helperStarted) {
+    // The helper's done signal is the barrier before the HUD and present.
+    s_helperStart.give();
+    rasterTileRows(0);
+    s_helperDone.take();
+  } else {
+    rasterTileRows(0);
+  }
+}
+
+}  // namespace game
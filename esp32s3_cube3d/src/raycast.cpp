@@ -0,0 +1,170 @@
+#include "raycast.h"
+
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace game {
+
+namespace {
+
+// Rows of the current screen column that already hold a surface. Rays run
+// front to back, so the first surface to claim a row wins.
+bool s_rowCovered[kScreenH];
+int s_rowsLeft = 0;
+// Every uncovered row lies in [s_openTop, s_openBottom).
+int s_openTop = 0;
+int s_openBottom = 0;
+
+float s_horizonRow = kScreenH * 0.5f;
+// Focal length in view pixels (smaller when the view is scaled down).
+float s_viewFocal = kFocal;
+
+// Screen row of world height h at camera depth s (s > 0).
+float rowAt(float h, float s) {
+  return s_horizonRow - s_viewFocal * (h - s_camY) / s;
+}
+
+// First pixel row whose centre is at or below the given edge.
+int rowCeil(float v) {
+  return static_cast<int>(ceilf(v - 0.5f));
+}
+
+void fillColumnSpan(Pixel *column, float top, float bottom, Pixel color) {
+  const int y0 = std::max(s_openTop, rowCeil(top));
+  const int y1 = std::min(s_openBottom, rowCeil(bottom));
+  if (y0 >= y1) {
+    return;
+  }
+  for (int y = y0; y < y1; ++y) {
+    if (!s_rowCovered[y]) {
+      s_rowCovered[y] = true;
+      column[y * kScreenW] = color;
+      s_rowsLeft--;
+    }
+  }
+  while (s_openTop < s_openBottom && s_rowCovered[s_openTop]) {
+    s_openTop++;
+  }
+  while (s_openBottom > s_openTop && s_rowCovered[s_openBottom - 1]) {
+    s_openBottom--;
+  }
+}
+
+// Draws the exposed faces of column (x, z) that the ray sees between depths
+// s0 and s1. entryFace is the face bit the ray crossed to enter the column,
+// or 0 for the column the camera stands in.
+void drawCell(Pixel *column, int x, int z, uint8_t entryFace, float s0, float s1) {
+  const int yMin = s_colFaceMinY[x][z];
+  if (yMin < 0) {
+    return;
+  }
+  const int yMax = s_colFaceMaxY[x][z];
+
+  // Side faces all sit on the entry plane, in front of any top in this cell.
+  if (entryFace != 0) {
+    for (int y = yMin; y <= yMax; ++y) {
+      if ((s_faceMask[x][y][z] & entryFace) == 0) {
+        continue;
+      }
+      fillColumnSpan(column, rowAt(static_cast<float>(y + 1), s0), rowAt(static_cast<float>(y), s0),
+                     toPixel(blockSideColor(s_voxel[x][y][z])));
+    }
+  }
+
+  // Tops are only visible from above; higher ones hide lower ones.
+  const int yTopMax = std::min(yMax, static_cast<int>(floorf(s_camY)) - 1);
+  for (int y = yTopMax; y >= yMin; --y) {
+    if ((s_faceMask[x][y][z] & FACE_TOP) == 0) {
+      continue;
+    }
+    const float h = static_cast<float>(y + 1);
+    fillColumnSpan(column, rowAt(h, s1), rowAt(h, s0), toPixel(blockTopColor(s_voxel[x][y][z])));
+  }
+}
+
+void castColumn(Pixel *fb, int sx) {
+  for (int y = 0; y < s_viewH; ++y) {
+    s_rowCovered[y] = false;
+  }
+  s_rowsLeft = s_viewH;
+  s_openTop = 0;
+  s_openBottom = s_viewH;
+  Pixel *column = fb + sx;
+
+  // Ray direction in the xz plane with a unit forward component, so the
+  // ray parameter is camera-space depth.
+  const float t = (static_cast<float>(sx) + 0.5f - s_viewW * 0.5f) / s_viewFocal;
+  const float dirX = s_camSy + s_camCy * t;
+  const float dirZ = s_camCy - s_camSy * t;
+  const float maxDepth = (s_renderRadius + 1.0f) / sqrtf(dirX * dirX + dirZ * dirZ);
+  const float radiusSq = s_renderRadius * s_renderRadius;
+
+  int cx = static_cast<int>(floorf(s_camX));
+  int cz = static_cast<int>(floorf(s_camZ));
+  const int stepX = (dirX < 0.0f) ? -1 : 1;
+  const int stepZ = (dirZ < 0.0f) ? -1 : 1;
+  const float deltaX = (dirX != 0.0f) ? fabsf(1.0f / dirX) : 1e30f;
+  const float deltaZ = (dirZ != 0.0f) ? fabsf(1.0f / dirZ) : 1e30f;
+  float nextX = ((stepX > 0) ? (static_cast<float>(cx + 1) - s_camX) : (s_camX - static_cast<float>(cx))) * deltaX;
+  float nextZ = ((stepZ > 0) ? (static_cast<float>(cz + 1) - s_camZ) : (s_camZ - static_cast<float>(cz))) * deltaZ;
+  // Crossing +x enters a column through its west face, and so on.
+  const uint8_t faceX = (stepX > 0) ? FACE_WEST : FACE_EAST;
+  const uint8_t faceZ = (stepZ > 0) ? FACE_NORTH : FACE_SOUTH;
+
+  float s0 = 0.0f;
+  uint8_t entryFace = 0;
+  while (s_rowsLeft > 0 && s0 <= maxDepth) {
+    const float s1 = std::min(nextX, nextZ);
+    if (cx >= 0 && cx < kWorldW && cz >= 0 && cz < kWorldD) {
+      const float dx = (static_cast<float>(cx) + 0.5f) - s_camX;
+      const float dz = (static_cast<float>(cz) + 0.5f) - s_camZ;
+      if (dx * dx + dz * dz <= radiusSq) {
+        drawCell(column, cx, cz, entryFace, std::max(s0, kNearPlane), std::max(s1, kNearPlane));
+      }
+    }
+    if (nextX < nextZ) {
+      cx += stepX;
+      s0 = nextX;
+      nextX += deltaX;
+      entryFace = faceX;
+    } else {
+      cz += stepZ;
+      s0 = nextZ;
+      nextZ += deltaZ;
+      entryFace = faceZ;
+    }
+    if ((cx < 0 && stepX < 0) || (cx >= kWorldW && stepX > 0) || (cz < 0 && stepZ < 0) ||
+        (cz >= kWorldD && stepZ > 0)) {
+      break;
+    }
+  }
+
+  // Same sky / ground-fog split as the polygon path.
+  const Pixel sky = toPixel(kSky);
+  const Pixel fog = toPixel(kGroundFog);
+  for (int y = s_openTop; y < s_openBottom; ++y) {
+    if (!s_rowCovered[y]) {
+      column[y * kScreenW] = (y < s_viewH / 2) ? sky : fog;
+    }
+  }
+}
+
+}  // namespace
+
+void raycastWorld() {
+  meshUpdate();
+  s_viewFocal = kFocal * static_cast<float>(s_viewW) / kScreenW;
+  // Looking up or down shifts the horizon instead of rotating the view, so
+  // the image is exact only at zero pitch. Clamped near straight up/down.
+  const float shear = s_viewFocal * tanf(s_pitch);
+  s_horizonRow = s_viewH * 0.5f + std::max(-2.0f * s_viewH, std::min(2.0f * s_viewH, shear));
+
+  Pixel *fb = canvas.getBuffer();
+  for (int sx = 0; sx < s_viewW; ++sx) {
+    castColumn(fb, sx);
+  }
+}
+
+}  // namespace game
@@ -1,10 +1,15 @@
 #include "rendering.h"
 
 #include "controls.h"
+#include "mesh_cache.h"
+#include "raster.h"
+#include "raycast.h"
 #include "world.h"
 
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 
 namespace game {
 
@@ -18,16 +23,54 @@ float cameraSpaceZ(float wx, float wy, float wz) {
   return dy * s_camSp + yawZ * s_camCp;
 }
 
-void tryAddFace(const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d, uint16_t color) {
-  if (s_faceCount >= kMaxFaces) {
+constexpr int kLatticeW = kWorldW + 1;
+constexpr int kLatticeH = kWorldHMax + 1;
+constexpr int kLatticeD = kWorldD + 1;
+
+// Per-frame projection of voxel lattice corners, valid where the stamp
+// matches s_latticeFrame. Corners at or behind the near plane keep
+// cz <= kNearPlane and no screen position.
+ProjVert s_latticeVert[kLatticeW][kLatticeH][kLatticeD];
+uint8_t s_latticeStamp[kLatticeW][kLatticeH][kLatticeD];
+uint8_t s_latticeFrame = 0;
+
+void beginLatticeFrame() {
+  s_latticeFrame++;
+  if (s_latticeFrame == 0) {
+    memset(s_latticeStamp, 0, sizeof(s_latticeStamp));
+    s_latticeFrame = 1;
+  }
+}
+
+struct LatticePt {
+  int x;
+  int y;
+  int z;
+};
+
+const ProjVert &latticeVertex(const LatticePt &v) {
+  ProjVert &p = s_latticeVert[v.x][v.y][v.z];
+  uint8_t &stamp = s_latticeStamp[v.x][v.y][v.z];
+  if (stamp != s_latticeFrame) {
+    stamp = s_latticeFrame;
+    const Vec3 w = {static_cast<float>(v.x), static_cast<float>(v.y), static_cast<float>(v.z)};
+    if (!projectToScreen(w, p)) {
+      p.cz = std::min(kNearPlane, cameraSpaceZ(w.x, w.y, w.z));
+    }
+  }
+  return p;
+}
+
+// Native screen coordinate to the reduced world view.
+int16_t toView(int16_t v) {
+  return static_cast<int16_t>((v * s_viewScale) >> 2);
+}
+
+void tryAddFace(const ProjVert &p0, const ProjVert &p1, const ProjVert &p2, const ProjVert &p3, uint16_t color) {
+  if (s_faceCount >= s_faceBudget) {
     return;
   }
-  ProjVert p0;
-  ProjVert p1;
-  ProjVert p2;
-  ProjVert p3;
-  if (!projectToScreen(a, p0) || !projectToScreen(b, p1) || !projectToScreen(c, p2) ||
-      !projectToScreen(d, p3)) {
+  if (p0.cz <= kNearPlane || p1.cz <= kNearPlane || p2.cz <= kNearPlane || p3.cz <= kNearPlane) {
     return;
   }
   const int16_t minX = std::min(std::min(p0.sx, p1.sx), std::min(p2.sx, p3.sx));
@@ -42,11 +85,753 @@ void tryAddFace(const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d, uint
   f.p[1] = p1;
   f.p[2] = p2;
   f.p[3] = p3;
+  if (s_viewScale != kViewScaleFull) {
+    for (ProjVert &p : f.p) {
+      p.sx = toView(p.sx);
+      p.sy = toView(p.sy);
+    }
+  }
   f.depth = (p0.cz + p1.cz + p2.cz + p3.cz) * 0.25f;
-  f.color = color;
+  f.color = toPixel(color);
+}
+
+// Voxel that owns cell (i, j) of a merged quad.
+void quadCell(int x, int y, int z, uint8_t dir, int i, int j, int *ux, int *uy, int *uz) {
+  *ux = x;
+  *uy = y;
+  *uz = z;
+  if (dir == FACE_TOP) {
+    *ux += i;
+    *uz += j;
+  } else if (dir == FACE_NORTH || dir == FACE_SOUTH) {
+    *ux += i;
+    *uy += j;
+  } else {
+    *uy += j;
+    *uz += i;
+  }
+}
+
+// Emits a (possibly merged) cached face after the backface test. Merged quads
+// that cross the near plane fall back to unit faces, so a large quad next to
+// the camera does not vanish as a whole.
+void emitQuad(int x, int y, int z, uint8_t dir, int du, int dv, uint16_t color) {
+  // Lattice corners of the face, in the winding the rasterizers expect.
+  LatticePt q[4];
+  switch (dir) {
+    case FACE_TOP:
+      if (s_camY <= static_cast<float>(y + 1)) {
+        return;
+      }
+      q[0] = {x, y + 1, z};
+      q[1] = {x + du, y + 1, z};
+      q[2] = {x + du, y + 1, z + dv};
+      q[3] = {x, y + 1, z + dv};
+      break;
+    case FACE_NORTH:
+      if (s_camZ >= static_cast<float>(z)) {
+        return;
+      }
+      q[0] = {x, y, z};
+      q[1] = {x + du, y, z};
+      q[2] = {x + du, y + dv, z};
+      q[3] = {x, y + dv, z};
+      break;
+    case FACE_SOUTH:
+      if (s_camZ <= static_cast<float>(z + 1)) {
+        return;
+      }
+      q[0] = {x + du, y, z + 1};
+      q[1] = {x, y, z + 1};
+      q[2] = {x, y + dv, z + 1};
+      q[3] = {x + du, y + dv, z + 1};
+      break;
+    case FACE_WEST:
+      if (s_camX >= static_cast<float>(x)) {
+        return;
+      }
+      q[0] = {x, y, z + du};
+      q[1] = {x, y, z};
+      q[2] = {x, y + dv, z};
+      q[3] = {x, y + dv, z + du};
+      break;
+    default:
+      if (s_camX <= static_cast<float>(x + 1)) {
+        return;
+      }
+      q[0] = {x + 1, y, z};
+      q[1] = {x + 1, y, z + du};
+      q[2] = {x + 1, y + dv, z + du};
+      q[3] = {x + 1, y + dv, z};
+      break;
+  }
+
+  const ProjVert &p0 = latticeVertex(q[0]);
+  const ProjVert &p1 = latticeVertex(q[1]);
+  const ProjVert &p2 = latticeVertex(q[2]);
+  const ProjVert &p3 = latticeVertex(q[3]);
+  if ((du > 1 || dv > 1) &&
+      (p0.cz <= kNearPlane || p1.cz <= kNearPlane || p2.cz <= kNearPlane || p3.cz <= kNearPlane)) {
+    for (int j = 0; j < dv; ++j) {
+      for (int i = 0; i < du; ++i) {
+        int ux = 0;
+        int uy = 0;
+        int uz = 0;
+        quadCell(x, y, z, dir, i, j, &ux, &uy, &uz);
+        emitQuad(ux, uy, uz, dir, 1, 1, color);
+      }
+    }
+    return;
+  }
+  tryAddFace(p0, p1, p2, p3, color);
+}
+
+// World-space frustum plane; a point p is inside when n . p + d >= 0.
+struct FrustumPlane {
+  float nx;
+  float ny;
+  float nz;
+  float d;
+};
+
+FrustumPlane s_frustum[5];
+
+void setFrustumPlane(FrustumPlane &pl, float nx, float ny, float nz) {
+  pl.nx = nx;
+  pl.ny = ny;
+  pl.nz = nz;
+  pl.d = -(nx * s_camX + ny * s_camY + nz * s_camZ);
+}
+
+// Near, left, right, top and bottom planes from the projection in
+// projectToScreen(), widened by a pixel so edge faces are never lost.
+void buildFrustum() {
+  const float tx = (kScreenW * 0.5f + 1.0f) / kFocal;
+  const float ty = (kScreenH * 0.5f + 1.0f) / kFocal;
+  const float rx = s_camCy;
+  const float rz = -s_camSy;
+  const float ux = -s_camSy * s_camSp;
+  const float uy = s_camCp;
+  const float uz = -s_camCy * s_camSp;
+  const float fx = s_camSy * s_camCp;
+  const float fy = s_camSp;
+  const float fz = s_camCy * s_camCp;
+  setFrustumPlane(s_frustum[0], fx, fy, fz);
+  s_frustum[0].d -= kNearPlane;
+  setFrustumPlane(s_frustum[1], rx + tx * fx, tx * fy, rz + tx * fz);
+  setFrustumPlane(s_frustum[2], -rx + tx * fx, tx * fy, -rz + tx * fz);
+  setFrustumPlane(s_frustum[3], -ux + ty * fx, -uy + ty * fy, -uz + ty * fz);
+  setFrustumPlane(s_frustum[4], ux + ty * fx, uy + ty * fy, uz + ty * fz);
+}
+
+// Conservative AABB test: rejects the box only when it lies fully outside
+// one plane.
+bool boxInFrustum(float x0, float y0, float z0, float x1, float y1, float z1) {
+  for (const FrustumPlane &pl : s_frustum) {
+    const float px = (pl.nx >= 0.0f) ? x1 : x0;
+    const float py = (pl.ny >= 0.0f) ? y1 : y0;
+    const float pz = (pl.nz >= 0.0f) ? z1 : z0;
+    if (pl.nx * px + pl.ny * py + pl.nz * pz + pl.d < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Horizon occlusion: s_horizon[sx] is the highest screen row such that
+// everything from it down to the bottom edge is covered by nearer terrain.
+int16_t s_horizon[kScreenW];
+bool s_colVisible[kWorldW][kWorldD];
+
+// Calls fn(x, z) for every cell of a w x d grid at Manhattan distance r
+// from cell (cx, cz).
+template <typename Fn>
+void forEachRingCell(int w, int d, int cx, int cz, int r, Fn fn) {
+  for (int dx = -r; dx <= r; ++dx) {
+    const int x = cx + dx;
+    if (x < 0 || x >= w) {
+      continue;
+    }
+    const int dz = r - abs(dx);
+    if (cz - dz >= 0 && cz - dz < d) {
+      fn(x, cz - dz);
+    }
+    if (dz != 0 && cz + dz >= 0 && cz + dz < d) {
+      fn(x, cz + dz);
+    }
+  }
+}
+
+// Window columns at Manhattan distance r from the camera column.
+template <typename Fn>
+void forEachRingColumn(int cx, int cz, int r, Fn fn) {
+  forEachRingCell(kWorldW, kWorldD, cx, cz, r, fn);
+}
+
+bool faceBudgetFull() {
+  return s_faceCount >= s_faceBudget;
+}
+
+// Projects the corners of the box [x, x+1] x [y0, y1] x [z, z+1]. Returns
+// false when any corner is at or behind the near plane.
+bool projectColumnBox(int x, int z, int y0, int y1, const ProjVert **bottom, const ProjVert **top) {
+  for (int i = 0; i < 4; ++i) {
+    const int vx = x + (i & 1);
+    const int vz = z + (i >> 1);
+    bottom[i] = &latticeVertex({vx, y0, vz});
+    top[i] = &latticeVertex({vx, y1, vz});
+    if (bottom[i]->cz <= kNearPlane || top[i]->cz <= kNearPlane) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool columnHidden(int x, int z) {
+  const ProjVert *bottom[4];
+  const ProjVert *top[4];
+  if (!projectColumnBox(x, z, s_colFaceMinY[x][z], s_colFaceMaxY[x][z] + 1, bottom, top)) {
+    return false;
+  }
+  int minX = bottom[0]->sx;
+  int maxX = bottom[0]->sx;
+  int minY = bottom[0]->sy;
+  for (int i = 0; i < 4; ++i) {
+    minX = std::min<int>(minX, std::min(bottom[i]->sx, top[i]->sx));
+    maxX = std::max<int>(maxX, std::max(bottom[i]->sx, top[i]->sx));
+    minY = std::min<int>(minY, std::min(bottom[i]->sy, top[i]->sy));
+  }
+  minX = std::max(0, minX);
+  maxX = std::min(kScreenW - 1, maxX);
+  for (int sx = minX; sx <= maxX; ++sx) {
+    if (minY < s_horizon[sx]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Raises the horizon with the ground-connected solid run of a column. Only
+// screen columns where both the top and bottom outlines of the box project
+// are used, and there the covered rows are at least
+// [max top sy, min bottom sy], by convexity of the projected box.
+void raiseHorizon(int x, int z) {
+  const int groundTop = s_colGroundTop[x][z];
+  if (groundTop < 0) {
+    return;
+  }
+  const ProjVert *bottom[4];
+  const ProjVert *top[4];
+  if (!projectColumnBox(x, z, 0, groundTop + 1, bottom, top)) {
+    return;
+  }
+  int topMinX = top[0]->sx;
+  int topMaxX = top[0]->sx;
+  int topMaxY = top[0]->sy;
+  int botMinX = bottom[0]->sx;
+  int botMaxX = bottom[0]->sx;
+  int botMinY = bottom[0]->sy;
+  for (int i = 1; i < 4; ++i) {
+    topMinX = std::min<int>(topMinX, top[i]->sx);
+    topMaxX = std::max<int>(topMaxX, top[i]->sx);
+    topMaxY = std::max<int>(topMaxY, top[i]->sy);
+    botMinX = std::min<int>(botMinX, bottom[i]->sx);
+    botMaxX = std::max<int>(botMaxX, bottom[i]->sx);
+    botMinY = std::min<int>(botMinY, bottom[i]->sy);
+  }
+  // One pixel of slack on each side for rasterizer rounding.
+  const int x0 = std::max(0, std::max(topMinX, botMinX) + 1);
+  const int x1 = std::min(kScreenW - 1, std::min(topMaxX, botMaxX) - 1);
+  const int coverTop = topMaxY + 1;
+  const int coverBottom = botMinY - 1;
+  if (coverTop > coverBottom) {
+    return;
+  }
+  for (int sx = x0; sx <= x1; ++sx) {
+    // The run must reach rows that are already covered (or the screen edge).
+    if (coverBottom >= s_horizon[sx] - 1 && coverTop < s_horizon[sx]) {
+      s_horizon[sx] = static_cast<int16_t>(coverTop);
+    }
+  }
+}
+
+// Front-to-back pass over columns in Manhattan rings around the camera.
+// Along any ray |dx| and |dz| never decrease, so every potential occluder of
+// a column sits in an earlier ring; the horizon is raised only after a whole
+// ring has been tested.
+void buildColumnVisibility(float radiusSq) {
+  for (int sx = 0; sx < kScreenW; ++sx) {
+    s_horizon[sx] = kScreenH;
+  }
+  const int cx = static_cast<int>(floorf(s_camX));
+  const int cz = static_cast<int>(floorf(s_camZ));
+  // From inside terrain the missing interior faces let the view through
+  // hills, so ground runs are not occluders then.
+  if (!kHorizonCulling || isSolidVoxel(cx, static_cast<int>(floorf(s_camY)), cz)) {
+    memset(s_colVisible, 1, sizeof(s_colVisible));
+    return;
+  }
+  memset(s_colVisible, 0, sizeof(s_colVisible));
+  auto inRadius = [radiusSq](int x, int z) {
+    const float dcx = (static_cast<float>(x) + 0.5f) - s_camX;
+    const float dcz = (static_cast<float>(z) + 0.5f) - s_camZ;
+    return dcx * dcx + dcz * dcz <= radiusSq;
+  };
+  for (int r = 0; r < kWorldW + kWorldD; ++r) {
+    forEachRingColumn(cx, cz, r, [&](int x, int z) {
+      if (s_colFaceMinY[x][z] >= 0 && inRadius(x, z)) {
+        s_colVisible[x][z] = !columnHidden(x, z);
+      }
+    });
+    forEachRingColumn(cx, cz, r, [&](int x, int z) {
+      if (inRadius(x, z)) {
+        raiseHorizon(x, z);
+      }
+    });
+  }
 }
 
-void drawRemotePlayers() {
+// True when any column under a quad footprint survived the horizon pass.
+bool footprintVisible(int x, int z, int spanX, int spanZ) {
+  for (int i = 0; i < spanX; ++i) {
+    for (int j = 0; j < spanZ; ++j) {
+      if (s_colVisible[x + i][z + j]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool voxelColumnInView(int x, int z, float radiusSq);
+void emitVoxel(int x, int y, int z);
+
+// Unit faces of one brick, for bricks the quad pool had no room for.
+void emitBrickVoxels(int bx, int by, int bz, float radiusSq) {
+  const int y0 = by * kBrickSize;
+  const int y1 = std::min(kWorldHMax, y0 + kBrickSize);
+  for (int x = bx * kBrickSize; x < (bx + 1) * kBrickSize; ++x) {
+    for (int z = bz * kBrickSize; z < (bz + 1) * kBrickSize; ++z) {
+      if (!voxelColumnInView(x, z, radiusSq)) {
+        continue;
+      }
+      for (int y = y0; y < y1; ++y) {
+        emitVoxel(x, y, z);
+      }
+    }
+  }
+}
+
+// Bricks go out in Manhattan rings around the camera brick, so when the
+// face budget runs out it is the farthest geometry that is dropped.
+void emitGreedyQuads(float radiusSq) {
+  const int cbx = std::max(0, std::min(kBricksX - 1, static_cast<int>(floorf(s_camX)) / kBrickSize));
+  const int cbz = std::max(0, std::min(kBricksZ - 1, static_cast<int>(floorf(s_camZ)) / kBrickSize));
+  for (int r = 0; r < kBricksX + kBricksZ && !faceBudgetFull(); ++r) {
+    forEachRingCell(kBricksX, kBricksZ, cbx, cbz, r, [&](int bx, int bz) {
+      // Nearest column centre of the brick footprint against the render radius.
+      const float x0 = static_cast<float>(bx * kBrickSize) + 0.5f;
+      const float z0 = static_cast<float>(bz * kBrickSize) + 0.5f;
+      const float ncx = std::max(x0, std::min(x0 + kBrickSize - 1, s_camX)) - s_camX;
+      const float ncz = std::max(z0, std::min(z0 + kBrickSize - 1, s_camZ)) - s_camZ;
+      if (ncx * ncx + ncz * ncz > radiusSq) {
+        return;
+      }
+      // Whole column stack first, then each brick in it.
+      const float bx0 = static_cast<float>(bx * kBrickSize);
+      const float bz0 = static_cast<float>(bz * kBrickSize);
+      if (!boxInFrustum(bx0, 0.0f, bz0, bx0 + kBrickSize, static_cast<float>(kWorldHMax), bz0 + kBrickSize)) {
+        return;
+      }
+      for (int by = 0; by < kBricksY; ++by) {
+        const BrickMesh &mesh = s_brickMesh[bx][by][bz];
+        if (mesh.unitFaces) {
+          emitBrickVoxels(bx, by, bz, radiusSq);
+          continue;
+        }
+        if (mesh.count == 0) {
+          continue;
+        }
+        const float by0 = static_cast<float>(by * kBrickSize);
+        const float by1 = static_cast<float>(std::min(kWorldHMax, (by + 1) * kBrickSize));
+        if (!boxInFrustum(bx0, by0, bz0, bx0 + kBrickSize, by1, bz0 + kBrickSize)) {
+          continue;
+        }
+        for (int i = 0; i < mesh.count; ++i) {
+          const MeshQuad &mq = s_meshQuads[mesh.first + i];
+          // Extent of the quad footprint in columns.
+          int spanX = 1;
+          int spanZ = 1;
+          if (mq.dir == FACE_TOP) {
+            spanX = mq.du;
+            spanZ = mq.dv;
+          } else if (mq.dir == FACE_NORTH || mq.dir == FACE_SOUTH) {
+            spanX = mq.du;
+          } else {
+            spanZ = mq.du;
+          }
+          const float qx0 = static_cast<float>(mq.x) + 0.5f;
+          const float qz0 = static_cast<float>(mq.z) + 0.5f;
+          const float qx1 = qx0 + static_cast<float>(spanX - 1);
+          const float qz1 = qz0 + static_cast<float>(spanZ - 1);
+          const float dcx = std::max(qx0, std::min(qx1, s_camX)) - s_camX;
+          const float dcz = std::max(qz0, std::min(qz1, s_camZ)) - s_camZ;
+          if (dcx * dcx + dcz * dcz > radiusSq) {
+            continue;
+          }
+          if (!footprintVisible(mq.x, mq.z, spanX, spanZ)) {
+            continue;
+          }
+          // Skip quads whose whole bounding sphere sits behind the camera.
+          const float halfU = 0.5f * static_cast<float>(mq.du);
+          const float halfV = 0.5f * static_cast<float>(mq.dv);
+          const float centerCamZ = cameraSpaceZ(qx0 + 0.5f * (spanX - 1), static_cast<float>(mq.y) + 0.5f,
+                                                qz0 + 0.5f * (spanZ - 1));
+          if (centerCamZ < -1.1f - halfU - halfV) {
+            continue;
+          }
+          const float fcx = std::max(fabsf(qx0 - s_camX), fabsf(qx1 - s_camX));
+          const float fcz = std::max(fabsf(qz0 - s_camZ), fabsf(qz1 - s_camZ));
+          if (fcx * fcx + fcz * fcz <= radiusSq) {
+            emitQuad(mq.x, mq.y, mq.z, mq.dir, mq.du, mq.dv, mq.color);
+            continue;
+          }
+          // Quad straddles the render radius: keep the per-column cut-off.
+          for (int j = 0; j < mq.dv; ++j) {
+            for (int k = 0; k < mq.du; ++k) {
+              int ux = 0;
+              int uy = 0;
+              int uz = 0;
+              quadCell(mq.x, mq.y, mq.z, mq.dir, k, j, &ux, &uy, &uz);
+              const float ucx = (static_cast<float>(ux) + 0.5f) - s_camX;
+              const float ucz = (static_cast<float>(uz) + 0.5f) - s_camZ;
+              if (ucx * ucx + ucz * ucz <= radiusSq) {
+                emitQuad(ux, uy, uz, mq.dir, 1, 1, mq.color);
+              }
+            }
+          }
+        }
+      }
+    });
+  }
+}
+
+constexpr int32_t kLodNone = -1;
+
+// Far-tier merge key per column: surface height and top colour, or kLodNone.
+int32_t s_lodKey[kWorldW][kWorldD];
+
+int lodColumnTop(int x, int z) {
+  if (x < 0 || z < 0 || x >= kWorldW || z >= kWorldD) {
+    return 0;
+  }
+  return s_colSurfaceY[x][z] + 1;
+}
+
+// Side of far column (x, z) facing `dir`: from the neighbour's surface up to
+// its own. Returns false when the neighbour is as high or higher.
+bool lodSideSpan(int x, int z, uint8_t dir, int *bottom, int *top, uint16_t *color) {
+  if (s_lodKey[x][z] == kLodNone) {
+    return false;
+  }
+  const int nx = x + ((dir == FACE_WEST) ? -1 : (dir == FACE_EAST) ? 1 : 0);
+  const int nz = z + ((dir == FACE_NORTH) ? -1 : (dir == FACE_SOUTH) ? 1 : 0);
+  *bottom = lodColumnTop(nx, nz);
+  *top = s_colSurfaceY[x][z] + 1;
+  *color = blockSideColor(s_voxel[x][*top - 1][z]);
+  return *bottom < *top;
+}
+
+// Far tier: columns between the LOD and render radii are drawn as their
+// surface only. Each height step towards a lower neighbour becomes one side
+// quad and tops merge into rectangles; both are capped at one brick in every
+// direction so the painter sort keeps working. Caves and overhangs out there are dropped.
+void emitLodColumns(float nearRadiusSq, float radiusSq) {
+  for (int x = 0; x < kWorldW; ++x) {
+    for (int z = 0; z < kWorldD; ++z) {
+      s_lodKey[x][z] = kLodNone;
+      const int surfaceY = s_colSurfaceY[x][z];
+      if (surfaceY < 0 || !s_colVisible[x][z]) {
+        continue;
+      }
+      const float dcx = (static_cast<float>(x) + 0.5f) - s_camX;
+      const float dcz = (static_cast<float>(z) + 0.5f) - s_camZ;
+      const float distSq = dcx * dcx + dcz * dcz;
+      if (distSq <= nearRadiusSq || distSq > radiusSq) {
+        continue;
+      }
+      const float x0 = static_cast<float>(x);
+      const float z0 = static_cast<float>(z);
+      if (!boxInFrustum(x0, 0.0f, z0, x0 + 1.0f, static_cast<float>(surfaceY + 1), z0 + 1.0f)) {
+        continue;
+      }
+      s_lodKey[x][z] = (surfaceY << 16) | blockTopColor(s_voxel[x][surfaceY][z]);
+    }
+  }
+
+  static constexpr uint8_t kSideDirs[] = {FACE_NORTH, FACE_SOUTH, FACE_WEST, FACE_EAST};
+  for (uint8_t dir : kSideDirs) {
+    // North/south sides run along x, west/east sides along z.
+    const bool alongX = (dir == FACE_NORTH || dir == FACE_SOUTH);
+    for (int a = 0; a < (alongX ? kWorldD : kWorldW); ++a) {
+      const int runLen = alongX ? kWorldW : kWorldD;
+      int b = 0;
+      while (b < runLen) {
+        const int x = alongX ? b : a;
+        const int z = alongX ? a : b;
+        int bottom = 0;
+        int top = 0;
+        uint16_t color = 0;
+        if (!lodSideSpan(x, z, dir, &bottom, &top, &color)) {
+          b++;
+          continue;
+        }
+        int run = 1;
+        while (run < kBrickSize && b + run < runLen) {
+          int nextBottom = 0;
+          int nextTop = 0;
+          uint16_t nextColor = 0;
+          if (!lodSideSpan(alongX ? x + run : x, alongX ? z : z + run, dir, &nextBottom, &nextTop, &nextColor) ||
+              nextBottom != bottom || nextTop != top || nextColor != color) {
+            break;
+          }
+          run++;
+        }
+        // Tall steps are split into brick-high pieces.
+        for (int y = bottom; y < top; y += kBrickSize) {
+          emitQuad(x, y, z, dir, run, std::min(kBrickSize, top - y), color);
+        }
+        b += run;
+      }
+    }
+  }
+
+  for (int z = 0; z < kWorldD; ++z) {
+    for (int x = 0; x < kWorldW; ++x) {
+      const int32_t key = s_lodKey[x][z];
+      if (key == kLodNone) {
+        continue;
+      }
+      int du = 1;
+      while (du < kBrickSize && x + du < kWorldW && s_lodKey[x + du][z] == key) {
+        du++;
+      }
+      int dv = 1;
+      while (dv < kBrickSize && z + dv < kWorldD) {
+        bool rowMatches = true;
+        for (int i = 0; i < du; ++i) {
+          if (s_lodKey[x + i][z + dv] != key) {
+            rowMatches = false;
+            break;
+          }
+        }
+        if (!rowMatches) {
+          break;
+        }
+        dv++;
+      }
+      for (int j = 0; j < dv; ++j) {
+        for (int i = 0; i < du; ++i) {
+          s_lodKey[x + i][z + j] = kLodNone;
+        }
+      }
+      emitQuad(x, key >> 16, z, FACE_TOP, du, dv, static_cast<uint16_t>(key & 0xFFFF));
+    }
+  }
+}
+
+constexpr int kSortRadixBits = kDepthSortBits / 2;
+constexpr int kSortBuckets = 1 << kSortRadixBits;
+
+uint16_t s_sortKey[kMaxFaces];
+uint16_t s_sortScratch[kMaxFaces];
+
+// One stable counting-sort pass over the index array on a 6-bit key digit.
+void radixPass(const uint16_t *src, uint16_t *dst, int count, int shift) {
+  uint16_t start[kSortBuckets] = {};
+  for (int i = 0; i < count; ++i) {
+    start[(s_sortKey[src[i]] >> shift) & (kSortBuckets - 1)]++;
+  }
+  uint16_t sum = 0;
+  for (int b = 0; b < kSortBuckets; ++b) {
+    const uint16_t n = start[b];
+    start[b] = sum;
+    sum = static_cast<uint16_t>(sum + n);
+  }
+  for (int i = 0; i < count; ++i) {
+    const uint16_t idx = src[i];
+    dst[start[(s_sortKey[idx] >> shift) & (kSortBuckets - 1)]++] = idx;
+  }
+}
+
+// Fills the first last - first entries of s_faceOrder with faces
+// [first, last), ordered far-to-near by a quantized depth key. Two radix
+// passes over 16-bit indices replace comparison sorting of the 40-byte faces.
+void sortFaceRange(int first, int last) {
+  constexpr int kKeyMax = (1 << kDepthSortBits) - 1;
+  constexpr float kKeyScale = static_cast<float>(kKeyMax) / kDepthSortMax;
+  const int count = last - first;
+  for (int i = first; i < last; ++i) {
+    const float d = std::max(0.0f, std::min(kDepthSortMax, s_faces[i].depth));
+    // Inverted so that ascending keys run far-to-near.
+    s_sortKey[i] = static_cast<uint16_t>(kKeyMax - static_cast<int>(d * kKeyScale));
+    s_faceOrder[i - first] = static_cast<uint16_t>(i);
+  }
+  if (count > 1) {
+    radixPass(s_faceOrder, s_sortScratch, count, 0);
+    radixPass(s_sortScratch, s_faceOrder, count, kSortRadixBits);
+  }
+}
+
+void sortFaces(int count) {
+  sortFaceRange(0, count);
+}
+
+// Column checks shared by the unit-face walks.
+bool voxelColumnInView(int x, int z, float radiusSq) {
+  const int colMinY = s_colFaceMinY[x][z];
+  if (colMinY < 0) {
+    return false;
+  }
+  const float dcx = (static_cast<float>(x) + 0.5f) - s_camX;
+  const float dcz = (static_cast<float>(z) + 0.5f) - s_camZ;
+  if (dcx * dcx + dcz * dcz > radiusSq) {
+    return false;
+  }
+  if (!s_colVisible[x][z]) {
+    return false;
+  }
+  const float cx0 = static_cast<float>(x);
+  const float cz0 = static_cast<float>(z);
+  return boxInFrustum(cx0, static_cast<float>(colMinY), cz0, cx0 + 1.0f,
+                      static_cast<float>(s_colFaceMaxY[x][z] + 1), cz0 + 1.0f);
+}
+
+void emitVoxel(int x, int y, int z) {
+  const uint8_t mask = s_faceMask[x][y][z];
+  if (mask == 0) {
+    return;
+  }
+
+  const float xf = static_cast<float>(x);
+  const float yf = static_cast<float>(y);
+  const float zf = static_cast<float>(z);
+
+  // Culling optimization: skip blocks fully behind the camera.
+  const float blockCamZ = cameraSpaceZ(xf + 0.5f, yf + 0.5f, zf + 0.5f);
+  if (blockCamZ < -1.1f) {
+    return;
+  }
+
+  const uint8_t blockId = s_voxel[x][y][z];
+  const uint16_t sideColor = blockSideColor(blockId);
+  const uint16_t topColor = blockTopColor(blockId);
+
+  // Exposed faces come from the cache; only the backface test runs per frame.
+  if (mask & FACE_TOP) {
+    emitQuad(x, y, z, FACE_TOP, 1, 1, topColor);
+  }
+  if (mask & FACE_NORTH) {
+    emitQuad(x, y, z, FACE_NORTH, 1, 1, sideColor);
+  }
+  if (mask & FACE_SOUTH) {
+    emitQuad(x, y, z, FACE_SOUTH, 1, 1, sideColor);
+  }
+  if (mask & FACE_WEST) {
+    emitQuad(x, y, z, FACE_WEST, 1, 1, sideColor);
+  }
+  if (mask & FACE_EAST) {
+    emitQuad(x, y, z, FACE_EAST, 1, 1, sideColor);
+  }
+}
+
+// Columns in Manhattan rings around the camera column, nearest first.
+void emitVoxelFaces(float radiusSq) {
+  const int cx = static_cast<int>(floorf(s_camX));
+  const int cz = static_cast<int>(floorf(s_camZ));
+  const int maxRing = 2 * static_cast<int>(ceilf(s_renderRadius));
+
+  for (int r = 0; r <= maxRing && !faceBudgetFull(); ++r) {
+    forEachRingColumn(cx, cz, r, [&](int x, int z) {
+      if (!voxelColumnInView(x, z, radiusSq)) {
+        return;
+      }
+      for (int y = s_colFaceMinY[x][z]; y <= s_colFaceMaxY[x][z]; ++y) {
+        emitVoxel(x, y, z);
+      }
+    });
+  }
+}
+
+// Cells lo..hi ordered far-to-near as seen from cell c: each side is walked
+// from its far end inwards, and the cell holding the camera comes last.
+int axisOrder(int lo, int hi, int c, int8_t *out) {
+  int n = 0;
+  for (int i = lo; i <= std::min(hi, c - 1); ++i) {
+    out[n++] = static_cast<int8_t>(i);
+  }
+  for (int i = hi; i >= std::max(lo, c + 1); --i) {
+    out[n++] = static_cast<int8_t>(i);
+  }
+  if (c >= lo && c <= hi) {
+    out[n++] = static_cast<int8_t>(c);
+  }
+  return n;
+}
+
+// Same faces as emitVoxelFaces, in exact reverse painter order. A cube can
+// only hide one that is no nearer to the camera cell on every axis, so the
+// three nested far-to-near axis walks draw every occluder after what it
+// hides. They run backwards here so the face budget keeps the nearest
+// faces; the caller reverses the indices into s_faceOrder.
+void emitVoxelFacesOrdered(float radiusSq) {
+  const int cx = static_cast<int>(floorf(s_camX));
+  const int cy = static_cast<int>(floorf(s_camY));
+  const int cz = static_cast<int>(floorf(s_camZ));
+  const int r = static_cast<int>(ceilf(s_renderRadius));
+  int8_t xs[kWorldW];
+  int8_t zs[kWorldD];
+  int8_t ys[kWorldHMax];
+  const int nx = axisOrder(std::max(0, cx - r), std::min(kWorldW - 1, cx + r), cx, xs);
+  const int nz = axisOrder(std::max(0, cz - r), std::min(kWorldD - 1, cz + r), cz, zs);
+
+  for (int i = nx - 1; i >= 0 && !faceBudgetFull(); --i) {
+    const int x = xs[i];
+    for (int k = nz - 1; k >= 0; --k) {
+      const int z = zs[k];
+      if (!voxelColumnInView(x, z, radiusSq)) {
+        continue;
+      }
+      const int ny = axisOrder(s_colFaceMinY[x][z], s_colFaceMaxY[x][z], cy, ys);
+      for (int j = ny - 1; j >= 0; --j) {
+        emitVoxel(x, ys[j], z);
+      }
+    }
+  }
+}
+
+void drawFacesPainter() {
+  rasterClearView();
+  for (int i = 0; i < s_faceCount; ++i) {
+    const FaceQuad &f = s_faces[s_faceOrder[i]];
+    if (kNativeQuadFill) {
+      rasterFillQuad(f);
+    } else {
+      const uint16_t rgb = pixelRgb(f.color);
+      canvas.fillTriangle(f.p[0].sx, f.p[0].sy, f.p[1].sx, f.p[1].sy, f.p[2].sx, f.p[2].sy, rgb);
+      canvas.fillTriangle(f.p[0].sx, f.p[0].sy, f.p[2].sx, f.p[2].sy, f.p[3].sx, f.p[3].sy, rgb);
+    }
+    if (kDrawEdges) {
+      canvas.drawLine(f.p[0].sx, f.p[0].sy, f.p[1].sx, f.p[1].sy, kEdge);
+      canvas.drawLine(f.p[1].sx, f.p[1].sy, f.p[2].sx, f.p[2].sy, kEdge);
+      canvas.drawLine(f.p[2].sx, f.p[2].sy, f.p[3].sx, f.p[3].sy, kEdge);
+      canvas.drawLine(f.p[3].sx, f.p[3].sy, f.p[0].sx, f.p[0].sy, kEdge);
+    }
+  }
+}
+
+// depthTested: clip billboards against the kRasterMode depth buffer.
+void drawRemotePlayers(bool depthTested) {
   constexpr uint16_t kBody = rgb565(242, 106, 88);
   constexpr uint16_t kOutline = rgb565(255, 226, 86);
 
@@ -62,6 +847,10 @@ void drawRemotePlayers() {
     if (!projectToScreen(feet, pFeet) || !projectToScreen(head, pHead)) {
       continue;
     }
+    pFeet.sx = toView(pFeet.sx);
+    pFeet.sy = toView(pFeet.sy);
+    pHead.sx = toView(pHead.sx);
+    pHead.sy = toView(pHead.sy);
     int yTop = std::min<int>(pHead.sy, pFeet.sy);
     int yBottom = std::max<int>(pHead.sy, pFeet.sy);
     int h = yBottom - yTop;
@@ -69,28 +858,137 @@ void drawRemotePlayers() {
       h = 4;
       yBottom = yTop + h;
     }
-    if (h > kScreenH) {
-      h = kScreenH;
+    if (h > s_viewH) {
+      h = s_viewH;
       yBottom = yTop + h;
     }
     int w = std::max<int>(2, h / 4);
     const int xLeft = pHead.sx - w / 2;
     const int xRight = xLeft + w - 1;
 
-    if (xRight < 0 || xLeft >= kScreenW || yBottom < 0 || yTop >= kScreenH) {
+    if (xRight < 0 || xLeft >= s_viewW || yBottom < 0 || yTop >= s_viewH) {
       continue;
     }
 
     const int clipX0 = std::max(0, xLeft);
     const int clipY0 = std::max(0, yTop);
-    const int clipX1 = std::min(kScreenW - 1, xRight);
-    const int clipY1 = std::min(kScreenH - 1, yBottom);
+    const int clipX1 = std::min(s_viewW - 1, xRight);
+    const int clipY1 = std::min(s_viewH - 1, yBottom);
 
+    if (depthTested) {
+      // Depth-test the billboard against terrain at its nearer end.
+      const float cz = std::min(pFeet.cz, pHead.cz);
+      rasterDepthRect(clipX0, clipY0, clipX1, clipY1, cz, kBody);
+      rasterDepthRect(xLeft, yTop, xRight, yTop, cz, kOutline);
+      rasterDepthRect(xLeft, yTop + h - 1, xRight, yTop + h - 1, cz, kOutline);
+      rasterDepthRect(xLeft, yTop, xLeft, yTop + h - 1, cz, kOutline);
+      rasterDepthRect(xRight, yTop, xRight, yTop + h - 1, cz, kOutline);
+      continue;
+    }
     canvas.fillRect(clipX0, clipY0, clipX1 - clipX0 + 1, clipY1 - clipY0 + 1, kBody);
     canvas.drawRect(xLeft, yTop, w, h, kOutline);
   }
 }
 
+// Source column for each native column at the current view scale.
+uint8_t s_upscaleCol[kScreenW];
+Pixel s_upscaleRow[kScreenW];
+int s_governorHold = 0;
+
+// Frames to keep a governor decision before it may make another.
+constexpr int kGovernorHoldFrames = 20;
+
+// The face cap follows the covered area, i.e. the radius squared, under
+// the runtime ceiling s_faceBudgetCap.
+void setRenderRadius(float radius) {
+  s_renderRadius = radius;
+  const float share = (radius * radius) / (kRenderRadius * kRenderRadius);
+  s_faceBudget = std::min(s_faceBudgetCap, static_cast<int>(s_faceBudgetCap * share));
+}
+
+void setViewScale(uint8_t scale) {
+  s_viewScale = scale;
+  s_viewW = kScreenW * scale / kViewScaleFull;
+  s_viewH = kScreenH * scale / kViewScaleFull;
+  for (int x = 0; x < kScreenW; ++x) {
+    s_upscaleCol[x] = static_cast<uint8_t>(x * s_viewW / kScreenW);
+  }
+}
+
+// Nearest-neighbour expansion of the top-left view to the full canvas, in
+// place. Rows go bottom-up so no source row is overwritten before use, and
+// repeated source rows are copied from the row below instead of re-expanded.
+void upscaleView() {
+  Pixel *fb = canvas.getBuffer();
+  int lastSrcY = -1;
+  for (int y = kScreenH - 1; y >= 0; --y) {
+    const int srcY = y * s_viewH / kScreenH;
+    Pixel *dst = fb + y * kScreenW;
+    if (srcY == lastSrcY) {
+      memcpy(dst, dst + kScreenW, sizeof(s_upscaleRow));
+      continue;
+    }
+    const Pixel *src = fb + srcY * kScreenW;
+    for (int x = 0; x < kScreenW; ++x) {
+      s_upscaleRow[x] = src[s_upscaleCol[x]];
+    }
+    memcpy(dst, s_upscaleRow, sizeof(s_upscaleRow));
+    lastSrcY = srcY;
+  }
+}
+
+// Q16.16 copy of the camera for projectToScreenFixed().
+struct FixedCamera {
+  int32_t x;
+  int32_t y;
+  int32_t z;
+  int32_t cy;
+  int32_t sy;
+  int32_t cp;
+  int32_t sp;
+};
+
+constexpr int kRecipLutBits = 8;
+constexpr int32_t kFixedNear = static_cast<int32_t>(kNearPlane * 65536.0f);
+constexpr int32_t kFixedFocal = static_cast<int32_t>(kFocal);
+
+FixedCamera s_fixCam = {0, 0, 0, 65536, 0, 65536, 0};
+// 1 / m for mantissas m in [1, 2), sampled at bucket centres, Q0.16.
+uint16_t s_recipLut[1 << kRecipLutBits];
+bool s_recipLutReady = false;
+
+int32_t toFixed(float v) {
+  return static_cast<int32_t>(v * 65536.0f);
+}
+
+int32_t mulFixed(int32_t a, int32_t b) {
+  return static_cast<int32_t>((static_cast<int64_t>(a) * b) >> 16);
+}
+
+void initRecipLut() {
+  for (int i = 0; i < (1 << kRecipLutBits); ++i) {
+    const float m = 1.0f + (static_cast<float>(i) + 0.5f) / static_cast<float>(1 << kRecipLutBits);
+    s_recipLut[i] = static_cast<uint16_t>(65536.0f / m);
+  }
+  s_recipLutReady = true;
+}
+
+void syncFixedCamera() {
+  s_fixCam.x = toFixed(s_camX);
+  s_fixCam.y = toFixed(s_camY);
+  s_fixCam.z = toFixed(s_camZ);
+  s_fixCam.cy = toFixed(s_camCy);
+  s_fixCam.sy = toFixed(s_camSy);
+  s_fixCam.cp = toFixed(s_camCp);
+  s_fixCam.sp = toFixed(s_camSp);
+}
+
+// Screen coordinate from a Q16.16 pixel offset, truncated toward zero like
+// the float path's cast.
+int16_t fixedToScreen(int64_t v) {
+  return static_cast<int16_t>(v >= 0 ? (v >> 16) : -((-v) >> 16));
+}
+
 }  // namespace
 
 void updateCameraBasis() {
@@ -98,9 +996,17 @@ void updateCameraBasis() {
   s_camSy = sinf(s_yaw);
   s_camCp = cosf(s_pitch);
   s_camSp = sinf(s_pitch);
+  syncFixedCamera();
 }
 
 bool projectToScreen(const Vec3 &w, ProjVert &out) {
+  if (kFixedPointProjection) {
+    return projectToScreenFixed(w, out);
+  }
+  return projectToScreenFloat(w, out);
+}
+
+bool projectToScreenFloat(const Vec3 &w, ProjVert &out) {
   const float dx = w.x - s_camX;
   const float dy = w.y - s_camY;
   const float dz = w.z - s_camZ;
@@ -121,142 +1027,338 @@ bool projectToScreen(const Vec3 &w, ProjVert &out) {
   return true;
 }
 
+bool projectToScreenFixed(const Vec3 &w, ProjVert &out) {
+  const int32_t dx = toFixed(w.x) - s_fixCam.x;
+  const int32_t dy = toFixed(w.y) - s_fixCam.y;
+  const int32_t dz = toFixed(w.z) - s_fixCam.z;
+
+  const int32_t yawX = mulFixed(dx, s_fixCam.cy) - mulFixed(dz, s_fixCam.sy);
+  const int32_t yawZ = mulFixed(dx, s_fixCam.sy) + mulFixed(dz, s_fixCam.cy);
+  const int32_t camY = mulFixed(dy, s_fixCam.cp) - mulFixed(yawZ, s_fixCam.sp);
+  const int32_t camZ = mulFixed(dy, s_fixCam.sp) + mulFixed(yawZ, s_fixCam.cp);
+
+  if (camZ <= kFixedNear) {
+    return false;
+  }
+  if (!s_recipLutReady) {
+    initRecipLut();
+  }
+  // camZ = m * 2^(n - 16) with m in [1, 2). Table seed for 1/m, then one
+  // Newton step r' = r * (2 - m * r) for ~16 bits of precision.
+  const int n = 31 - __builtin_clz(static_cast<uint32_t>(camZ));
+  const uint32_t m = static_cast<uint32_t>(camZ) << (31 - n);  // Q1.31
+  const uint32_t r0 = s_recipLut[(m >> (31 - kRecipLutBits)) & ((1u << kRecipLutBits) - 1)];
+  const uint64_t e = (static_cast<uint64_t>(m >> 15) * r0);  // Q.32, ~1.0
+  const uint64_t r1 = (static_cast<uint64_t>(r0) * ((2ull << 32) - e)) >> 32;  // Q0.16
+
+  // Pixel offset in Q16.16: cam * kFocal / camZ = cam * kFocal * r1 >> n.
+  const int64_t px = (static_cast<int64_t>(yawX) * kFixedFocal * static_cast<int64_t>(r1)) >> n;
+  const int64_t py = (static_cast<int64_t>(camY) * kFixedFocal * static_cast<int64_t>(r1)) >> n;
+  out.sx = fixedToScreen((static_cast<int64_t>(kScreenW / 2) << 16) + px);
+  out.sy = fixedToScreen((static_cast<int64_t>(kScreenH / 2) << 16) - py);
+  out.cz = static_cast<float>(camZ) * (1.0f / 65536.0f);
+  return true;
+}
+
 void buildVisibleFaces() {
+  beginLatticeFrame();
+  buildFrustum();
   s_faceCount = 0;
-  const int cx = static_cast<int>(floorf(s_camX));
-  const int cz = static_cast<int>(floorf(s_camZ));
-  const int r = static_cast<int>(kRenderRadius);
-  const int minX = std::max(0, cx - r);
-  const int maxX = std::min(kWorldW - 1, cx + r);
-  const int minZ = std::max(0, cz - r);
-  const int maxZ = std::min(kWorldD - 1, cz + r);
-  const float radiusSq = kRenderRadius * kRenderRadius;
-
-  for (int x = minX; x <= maxX; ++x) {
-    for (int z = minZ; z <= maxZ; ++z) {
-      const float dcx = (static_cast<float>(x) + 0.5f) - s_camX;
-      const float dcz = (static_cast<float>(z) + 0.5f) - s_camZ;
-      if (dcx * dcx + dcz * dcz > radiusSq) {
-        continue;
-      }
+  const float radiusSq = s_renderRadius * s_renderRadius;
+  const float nearRadiusSq = std::min(kLodRadius * kLodRadius, radiusSq);
 
-      for (int y = 0; y < kWorldHMax; ++y) {
-        const uint8_t blockId = s_voxel[x][y][z];
-        if (blockId == BLOCK_AIR) {
-          continue;
-        }
+  meshUpdate();
+  buildColumnVisibility(radiusSq);
+  if (kOctantOrder) {
+    // Only the far tier is sorted; it lies behind everything nearer and is
+    // drawn first, followed by the near tier in reverse emission order.
+    emitVoxelFacesOrdered(nearRadiusSq);
+    const int nearCount = s_faceCount;
+    if (nearRadiusSq < radiusSq) {
+      emitLodColumns(nearRadiusSq, radiusSq);
+    }
+    const unsigned long sortStartUs = micros();
+    const int lodCount = s_faceCount - nearCount;
+    sortFaceRange(nearCount, s_faceCount);
+    for (int i = 0; i < nearCount; ++i) {
+      s_faceOrder[lodCount + i] = static_cast<uint16_t>(nearCount - 1 - i);
+    }
+    s_statSortUs += micros() - sortStartUs;
+    return;
+  }
 
-        const float xf = static_cast<float>(x);
-        const float yf = static_cast<float>(y);
-        const float zf = static_cast<float>(z);
+  if (kGreedyMeshing) {
+    emitGreedyQuads(nearRadiusSq);
+  } else {
+    emitVoxelFaces(nearRadiusSq);
+  }
+  if (nearRadiusSq < radiusSq) {
+    emitLodColumns(nearRadiusSq, radiusSq);
+  }
+  // The depth-buffer path resolves visibility per pixel and needs no order.
+  if (kRasterMode != RASTER_ZBUFFER) {
+    const unsigned long sortStartUs = micros();
+    sortFaces(s_faceCount);
+    s_statSortUs += micros() - sortStartUs;
+  }
+}
 
-        // Culling optimization: skip blocks fully behind the camera.
-        const float blockCamZ = cameraSpaceZ(xf + 0.5f, yf + 0.5f, zf + 0.5f);
-        if (blockCamZ < -1.1f) {
-          continue;
-        }
+void setFaceBudgetCap(int cap) {
+  s_faceBudgetCap = std::max(kFaceBudgetMin, std::min(kMaxFaces, cap));
+  setRenderRadius(s_renderRadius);
+}
 
-        const uint16_t sideColor = blockSideColor(blockId);
-        const uint16_t topColor = blockTopColor(blockId);
+void drawWorld() {
+  drawWorldWith(kRenderEngine);
+}
 
-        // Per-face backface culling based on camera side of the face plane.
-        if (!isSolidVoxel(x, y + 1, z) && s_camY > yf + 1.0f) {
-          tryAddFace({xf, yf + 1.0f, zf}, {xf + 1.0f, yf + 1.0f, zf}, {xf + 1.0f, yf + 1.0f, zf + 1.0f},
-                     {xf, yf + 1.0f, zf + 1.0f}, topColor);
-        }
-        if (!isSolidVoxel(x, y, z - 1) && s_camZ < zf) {
-          tryAddFace({xf, yf, zf}, {xf + 1.0f, yf, zf}, {xf + 1.0f, yf + 1.0f, zf}, {xf, yf + 1.0f, zf},
-                     sideColor);
-        }
-        if (!isSolidVoxel(x, y, z + 1) && s_camZ > zf + 1.0f) {
-          tryAddFace({xf + 1.0f, yf, zf + 1.0f}, {xf, yf, zf + 1.0f}, {xf, yf + 1.0f, zf + 1.0f},
-                     {xf + 1.0f, yf + 1.0f, zf + 1.0f}, sideColor);
-        }
-        if (!isSolidVoxel(x - 1, y, z) && s_camX < xf) {
-          tryAddFace({xf, yf, zf + 1.0f}, {xf, yf, zf}, {xf, yf + 1.0f, zf}, {xf, yf + 1.0f, zf + 1.0f},
-                     sideColor);
-        }
-        if (!isSolidVoxel(x + 1, y, z) && s_camX > xf + 1.0f) {
-          tryAddFace({xf + 1.0f, yf, zf}, {xf + 1.0f, yf, zf + 1.0f}, {xf + 1.0f, yf + 1.0f, zf + 1.0f},
-                     {xf + 1.0f, yf + 1.0f, zf}, sideColor);
-        }
-      }
+void drawWorldWith(RenderEngine engine) {
+  if (engine == ENGINE_POLYGON) {
+    buildVisibleFaces();
+  }
+  const unsigned long rasterStartUs = micros();
+  canvas.setViewport(s_viewW, s_viewH);
+  if (engine == ENGINE_RAYCAST) {
+    raycastWorld();
+    drawRemotePlayers(false);
+  } else {
+    if (kRasterMode == RASTER_SPANS) {
+      rasterFacesFrontToBack();
+    } else if (kRasterMode == RASTER_ZBUFFER) {
+      rasterFacesDepthTested();
+    } else if (kRasterMode == RASTER_TILED) {
+      rasterFacesTiled();
+    } else {
+      drawFacesPainter();
+    }
+    drawRemotePlayers(kRasterMode == RASTER_ZBUFFER);
+  }
+  canvas.setViewport(kScreenW, kScreenH);
+  if (s_viewScale != kViewScaleFull) {
+    upscaleView();
+  }
+  s_statRasterUs += micros() - rasterStartUs;
+}
+
+void renderGovernorUpdate(unsigned long frameUs) {
+  if (!kAdaptiveRadius && !kDynamicResolution) {
+    return;
+  }
+  s_frameUsAvg += (static_cast<float>(frameUs) - s_frameUsAvg) * 0.125f;
+  if (s_governorHold < kGovernorHoldFrames) {
+    ++s_governorHold;
+    return;
+  }
+
+  // Over budget: shed view distance first, then resolution.
+  if (s_frameUsAvg > kTargetFrameUs) {
+    if (kAdaptiveRadius && s_renderRadius > kRenderRadiusMin) {
+      setRenderRadius(std::max(kRenderRadiusMin, s_renderRadius - 1.0f));
+      s_governorNote = "radius_down";
+    } else if (kDynamicResolution && s_viewScale > kViewScaleMin) {
+      setViewScale(s_viewScale - 1);
+      s_governorNote = "scale_down";
+    } else {
+      s_governorNote = "at_floor";
+      return;
     }
+    s_governorHold = 0;
+    return;
+  }
+
+  const bool scaleNominal = !kDynamicResolution || s_viewScale >= kViewScaleFull;
+  const bool radiusNominal = !kAdaptiveRadius || s_renderRadius >= kRenderRadius;
+  if (scaleNominal && radiusNominal) {
+    s_governorNote = "steady";
+    return;
   }
 
-  if (s_faceCount > 1) {
-    std::sort(s_faces, s_faces + s_faceCount,
-              [](const FaceQuad &l, const FaceQuad &r) { return l.depth > r.depth; });
+  // Restore in reverse order, and only when the frame would still fit if
+  // its whole cost grew with the pixel count or the radius squared.
+  if (kDynamicResolution && s_viewScale < kViewScaleFull) {
+    const float up = static_cast<float>(s_viewScale + 1) / static_cast<float>(s_viewScale);
+    if (s_frameUsAvg * up * up < kTargetFrameUs * 0.9f) {
+      setViewScale(s_viewScale + 1);
+      s_governorNote = "scale_up";
+      s_governorHold = 0;
+    }
+    return;
+  }
+  if (kAdaptiveRadius && s_renderRadius < kRenderRadius) {
+    const float up = (s_renderRadius + 1.0f) / s_renderRadius;
+    if (s_frameUsAvg * up * up < kTargetFrameUs * 0.9f) {
+      setRenderRadius(std::min(kRenderRadius, s_renderRadius + 1.0f));
+      s_governorNote = "radius_up";
+      s_governorHold = 0;
+    }
   }
 }
 
-void drawWorld() {
-  canvas.fillScreen(kSky);
-  canvas.fillRect(0, kScreenH / 2, kScreenW, kScreenH / 2, kGroundFog);
+namespace {
 
-  buildVisibleFaces();
-  for (int i = 0; i < s_faceCount; ++i) {
-    const FaceQuad &f = s_faces[i];
-    canvas.fillTriangle(f.p[0].sx, f.p[0].sy, f.p[1].sx, f.p[1].sy, f.p[2].sx, f.p[2].sy, f.color);
-    canvas.fillTriangle(f.p[0].sx, f.p[0].sy, f.p[2].sx, f.p[2].sy, f.p[3].sx, f.p[3].sy, f.color);
-    if (kDrawEdges) {
-      canvas.drawLine(f.p[0].sx, f.p[0].sy, f.p[1].sx, f.p[1].sy, kEdge);
-      canvas.drawLine(f.p[1].sx, f.p[1].sy, f.p[2].sx, f.p[2].sy, kEdge);
-      canvas.drawLine(f.p[2].sx, f.p[2].sy, f.p[3].sx, f.p[3].sy, kEdge);
-      canvas.drawLine(f.p[3].sx, f.p[3].sy, f.p[0].sx, f.p[0].sy, kEdge);
+// HUD overlay: two strips drawn off-screen through GFX only when what they
+// show changes, then copied onto each frame as runs of opaque pixels.
+constexpr int kHudTopH = 30;
+constexpr int kHudBarH = 12;
+constexpr int kHudRunCap = 1024;
+
+struct HudRun {
+  uint8_t y;
+  uint8_t x;
+  uint8_t len;
+};
+
+struct HudLayer {
+  HudLayer(int16_t h, int y) : pixels(kScreenW, h), screenY(y) {}
+
+  FrameCanvas pixels;
+  int screenY;
+  bool valid = false;
+  // -1 when the strip has more runs than fit; it is then blitted by key.
+  int runCount = 0;
+  HudRun runs[kHudRunCap];
+};
+
+HudLayer s_hudTop(kHudTopH, 0);
+HudLayer s_hudBar(kHudBarH, kScreenH - kHudBarH);
+
+// Inputs the strips were last drawn from.
+uint16_t s_hudFps = 0;
+int32_t s_hudPos[3] = {0, 0, 0};
+int s_hudSlot = -1;
+HotbarSlot s_hudHotbar[kInvSlots];
+
+void buildHudRuns(HudLayer &layer) {
+  const Pixel key = toPixel(kHudKey);
+  const Pixel *src = layer.pixels.getBuffer();
+  const int rows = layer.pixels.height();
+  layer.runCount = 0;
+  for (int y = 0; y < rows; ++y) {
+    const Pixel *row = src + y * kScreenW;
+    int x = 0;
+    while (x < kScreenW) {
+      if (row[x] == key) {
+        x++;
+        continue;
+      }
+      const int start = x;
+      while (x < kScreenW && row[x] != key) {
+        x++;
+      }
+      if (layer.runCount == kHudRunCap) {
+        layer.runCount = -1;
+        return;
+      }
+      layer.runs[layer.runCount++] = {static_cast<uint8_t>(y), static_cast<uint8_t>(start),
+                                      static_cast<uint8_t>(x - start)};
     }
   }
+}
 
-  drawRemotePlayers();
+void blitHudLayer(const HudLayer &layer) {
+  const Pixel *src = layer.pixels.getBuffer();
+  Pixel *dst = canvas.getBuffer() + layer.screenY * kScreenW;
+  if (layer.runCount >= 0) {
+    for (int i = 0; i < layer.runCount; ++i) {
+      const HudRun &r = layer.runs[i];
+      const int off = r.y * kScreenW + r.x;
+      memcpy(dst + off, src + off, static_cast<size_t>(r.len) * sizeof(Pixel));
+    }
+    return;
+  }
+  const Pixel key = toPixel(kHudKey);
+  const int count = layer.pixels.height() * kScreenW;
+  for (int i = 0; i < count; ++i) {
+    if (src[i] != key) {
+      dst[i] = src[i];
+    }
+  }
 }
 
-void drawHud() {
-  canvas.setTextSize(1);
-  canvas.setTextWrap(false);
-  canvas.setCursor(2, 2);
-  canvas.setTextColor(ST77XX_GREEN);
-  canvas.print("FPS ");
-  canvas.print(s_fps);
+void renderHudTop() {
+  FrameCanvas &g = s_hudTop.pixels;
+  g.fillScreen(kHudKey);
+  g.setTextSize(1);
+  g.setTextWrap(false);
+  g.setCursor(2, 2);
+  g.setTextColor(ST77XX_GREEN);
+  g.print("FPS ");
+  g.print(s_fps);
 
-  canvas.setCursor(2, 12);
-  canvas.setTextColor(ST77XX_CYAN);
-  canvas.print("X");
-  canvas.print(s_camX, 1);
-  canvas.print(" Y");
-  canvas.print(s_camY, 1);
-  canvas.print(" Z");
-  canvas.print(s_camZ, 1);
-
-  canvas.setCursor(2, 22);
-  canvas.setTextColor(ST77XX_YELLOW);
-  canvas.print("BAR ");
-  canvas.print(s_selectedSlot + 1);
-  canvas.print("/");
-  canvas.print(kInvSlots);
-  canvas.print(" ");
-  canvas.setTextColor(ST77XX_WHITE);
-  canvas.print(blockShortName(s_hotbar[s_selectedSlot].blockId));
-  canvas.print("x");
-  canvas.print(s_hotbar[s_selectedSlot].count);
-  canvas.print(" T");
-  canvas.print(inventoryTotal());
+  g.setCursor(2, 12);
+  g.setTextColor(ST77XX_CYAN);
+  g.print("X");
+  g.print(s_camX, 1);
+  g.print(" Y");
+  g.print(s_camY, 1);
+  g.print(" Z");
+  g.print(s_camZ, 1);
+
+  g.setCursor(2, 22);
+  g.setTextColor(ST77XX_YELLOW);
+  g.print("BAR ");
+  g.print(s_selectedSlot + 1);
+  g.print("/");
+  g.print(kInvSlots);
+  g.print(" ");
+  g.setTextColor(ST77XX_WHITE);
+  g.print(blockShortName(s_hotbar[s_selectedSlot].blockId));
+  g.print("x");
+  g.print(s_hotbar[s_selectedSlot].count);
+  g.print(" T");
+  g.print(inventoryTotal());
+  buildHudRuns(s_hudTop);
+}
 
-  const int y0 = kScreenH - 12;
+void renderHudBar() {
+  FrameCanvas &g = s_hudBar.pixels;
+  g.fillScreen(kHudKey);
+  g.setTextSize(1);
+  g.setTextWrap(false);
   const int boxW = 30;
   const int gap = 2;
   const int totalW = kInvSlots * boxW + (kInvSlots - 1) * gap;
   int x0 = (kScreenW - totalW) / 2;
   for (int i = 0; i < kInvSlots; ++i) {
     const uint16_t frame = (i == s_selectedSlot) ? ST77XX_YELLOW : rgb565(170, 170, 170);
-    canvas.fillRect(x0 + 1, y0 + 1, boxW - 2, 9, blockTopColor(s_hotbar[i].blockId));
-    canvas.drawRect(x0, y0, boxW, 11, frame);
-    canvas.setCursor(x0 + 2, y0 + 2);
-    canvas.setTextColor(ST77XX_WHITE);
-    canvas.print(blockShortName(s_hotbar[i].blockId));
-    canvas.setCursor(x0 + 16, y0 + 2);
-    canvas.print(s_hotbar[i].count);
+    g.fillRect(x0 + 1, 1, boxW - 2, 9, blockTopColor(s_hotbar[i].blockId));
+    g.drawRect(x0, 0, boxW, 11, frame);
+    g.setCursor(x0 + 2, 2);
+    g.setTextColor(ST77XX_WHITE);
+    g.print(blockShortName(s_hotbar[i].blockId));
+    g.setCursor(x0 + 16, 2);
+    g.print(s_hotbar[i].count);
     x0 += boxW + gap;
   }
+  buildHudRuns(s_hudBar);
+}
+
+}  // namespace
+
+void drawHud() {
+  // The position is shown to one decimal, so only a change at that
+  // precision needs the top strip redrawn.
+  const int32_t pos[3] = {static_cast<int32_t>(lroundf(s_camX * 10.0f)),
+                          static_cast<int32_t>(lroundf(s_camY * 10.0f)),
+                          static_cast<int32_t>(lroundf(s_camZ * 10.0f))};
+  const bool barChanged = !s_hudBar.valid || s_selectedSlot != s_hudSlot ||
+                          memcmp(s_hotbar, s_hudHotbar, sizeof(s_hudHotbar)) != 0;
+  const bool topChanged = barChanged || !s_hudTop.valid || s_fps != s_hudFps ||
+                          memcmp(pos, s_hudPos, sizeof(s_hudPos)) != 0;
+  if (topChanged) {
+    renderHudTop();
+    s_hudTop.valid = true;
+    s_hudFps = s_fps;
+    memcpy(s_hudPos, pos, sizeof(s_hudPos));
+  }
+  if (barChanged) {
+    renderHudBar();
+    s_hudBar.valid = true;
+    s_hudSlot = s_selectedSlot;
+    memcpy(s_hudHotbar, s_hotbar, sizeof(s_hudHotbar));
+  }
+  blitHudLayer(s_hudTop);
+  blitHudLayer(s_hudBar);
 }
 
 void drawHomeScreen() {
@@ -277,12 +1379,11 @@ void drawHomeScreen() {
   canvas.setCursor(6, 44);
   canvas.print("mc_state:");
   canvas.setTextColor(ST77XX_CYAN);
-  canvas.print(s_mcState);
+  canvas.print(s_mcState.c_str());
 
-  String endpoint = s_mcHost + ":" + String(s_mcPort);
-  if (endpoint.length() > 22) {
-    endpoint = endpoint.substring(0, 22);
-  }
+  // Truncated to the 22 columns that fit the screen.
+  char endpoint[23];
+  snprintf(endpoint, sizeof(endpoint), "%s:%u", s_mcHost.c_str(), static_cast<unsigned int>(s_mcPort));
   canvas.setTextColor(rgb565(176, 218, 248));
   canvas.setCursor(6, 56);
   canvas.print(endpoint);
@@ -1,7 +1,10 @@
 #include "web_control.h"
 
+#include "bench.h"
 #include "controls.h"
 #include "mc_client.h"
+#include "mesh_cache.h"
+#include "rendering.h"
 
 namespace game {
 
@@ -213,6 +216,9 @@ void handleState() {
   out += "\"fps\":";
   out += String(s_fps);
   out += ",";
+  out += "\"fps_skipped\":";
+  out += String(s_fpsSkipped);
+  out += ",";
   out += "\"yaw\":";
   out += String(s_yaw, 4);
   out += ",";
@@ -247,6 +253,30 @@ void handleState() {
     out += String(s_hotbar[i].blockId);
   }
   out += "],";
+  out += "\"render_radius\":";
+  out += String(s_renderRadius, 1);
+  out += ",";
+  out += "\"face_budget\":";
+  out += String(s_faceBudget);
+  out += ",";
+  out += "\"face_budget_cap\":";
+  out += String(s_faceBudgetCap);
+  out += ",";
+  out += "\"mesh_overflow_bricks\":";
+  out += String(s_meshOverflowBricks);
+  out += ",";
+  out += "\"view_w\":";
+  out += String(s_viewW);
+  out += ",";
+  out += "\"view_h\":";
+  out += String(s_viewH);
+  out += ",";
+  out += "\"frame_us\":";
+  out += String(static_cast<unsigned long>(s_frameUsAvg));
+  out += ",";
+  out += "\"governor\":\"";
+  out += s_governorNote;
+  out += "\",";
   out += "\"mc_state\":\"";
   out += s_mcState;
   out += "\",";
@@ -384,6 +414,41 @@ void handleReleaseAll() {
   server.send(200, "application/json", "{\"ok\":true}");
 }
 
+void handleFaceBudget() {
+  // toInt() reads "abc" as 0, so require the whole argument to be a number.
+  const String maxArg = server.arg("max");
+  char *end = nullptr;
+  const long maxFaces = strtol(maxArg.c_str(), &end, 10);
+  if (maxArg.length() == 0 || *end != '\0') {
+    server.send(400, "application/json", "{\"ok\":false,\"err\":\"bad_max\"}");
+    return;
+  }
+  setFaceBudgetCap(static_cast<int>(maxFaces));
+  String out = "{\"ok\":true,\"face_budget_cap\":";
+  out += String(s_faceBudgetCap);
+  out += ",\"face_budget\":";
+  out += String(s_faceBudget);
+  out += "}";
+  server.send(200, "application/json", out);
+}
+
+void handleBench() {
+  const String what = server.arg("what");
+  if (what == "proj") {
+    server.send(200, "application/json", benchProjectionJson());
+    return;
+  }
+  if (what == "engine") {
+    server.send(200, "application/json", benchEngineJson());
+    return;
+  }
+  if (what == "quad") {
+    server.send(200, "application/json", benchQuadFillJson());
+    return;
+  }
+  server.send(400, "application/json", "{\"ok\":false,\"err\":\"bad_bench\"}");
+}
+
 }  // namespace
 
 String wifiStateName() {
@@ -423,6 +488,8 @@ void setupWeb() {
   server.on("/api/release_all", HTTP_GET, handleReleaseAll);
   server.on("/api/mc_cfg", HTTP_GET, handleMcCfg);
   server.on("/api/mc_reconnect", HTTP_GET, handleMcReconnect);
+  server.on("/api/bench", HTTP_GET, handleBench);
+  server.on("/api/face_budget", HTTP_GET, handleFaceBudget);
   server.begin();
 }
 
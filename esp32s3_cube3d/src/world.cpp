@@ -1,5 +1,7 @@
 #include "world.h"
 
+#include "mesh_cache.h"
+
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
@@ -33,6 +35,8 @@ void clearWorld() {
       }
     }
   }
+  s_worldVersion++;
+  meshInvalidateAll();
 }
 
 void buildWorld() {
@@ -73,6 +77,8 @@ void buildWorld() {
       }
     }
   }
+  s_worldVersion++;
+  meshInvalidateAll();
 }
 
 bool isSolidVoxel(int x, int y, int z) {
@@ -92,7 +98,12 @@ void setVoxel(int x, int y, int z, uint8_t blockId) {
   if (y < 0 || y >= kWorldHMax) {
     return;
   }
+  if (s_voxel[x][y][z] == blockId) {
+    return;
+  }
   s_voxel[x][y][z] = blockId;
+  s_worldVersion++;
+  meshVoxelChanged(x, y, z);
 }
 
 int supportYBelowPlayer(int x, int z, float camY) {